@@ -32,37 +32,59 @@
 
 #include "usb_descriptors.h"
 #include "SwiCC_RP2040.h"
+#include "swicc_movie.h"
+#include "swicc_macro.h"
+#include "swicc_vsync.h"
+#include "swicc_trace.h"
+#include "swicc_hal.h"
 
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
 #include "hardware/irq.h"
 #include "hardware/uart.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
 
 //--------------------------------------------------------------------
 // Global variables
 //--------------------------------------------------------------------
 
-// Controller reports and ring buffer.
-USB_ControllerReport_Input_t neutral_con, current_con;
-USB_ControllerReport_Input_t con_data_buff[CON_BUFF_LEN];
-USB_ControllerReport_Input_t rec_data_buff[REC_BUFF_LEN];
-uint8_t rec_rle_buff[REC_BUFF_LEN]; // run length encoding buffer
-unsigned int queue_tail, queue_head, rec_head, stream_head;
-
-// VSYNC timing
-unsigned int frame_delay_us = 10000;
-bool vsync_en = false;
-
-// State variables
-uint8_t action_mode = A_PLAY;
-bool usb_connected = false;
-bool led_on = true;
-uint8_t vsync_count = 0;
-uint8_t uart_count = 0;
-uint8_t sent_count = 0;
-uint8_t lag_amount = 0;
-bool recording = false;
-bool recording_wrap = false;
+// UART receive ring, filled by DMA.  Must be aligned to its size for the
+// DMA address wrapping to work.
+uint8_t rx_ring[RX_RING_LEN] __attribute__((aligned(RX_RING_LEN)));
+int rx_dma_chan;
+uint32_t rx_dma_base = 0;   // bytes written by previous DMA runs
+uint32_t rx_read_count = 0; // bytes consumed by the parser
+unsigned int rx_overrun_count = 0;
+
+// UART transmit ring, drained by the TX interrupt.  head and tail are free
+// running byte counts.
+uint8_t tx_ring[TX_RING_LEN];
+volatile uint32_t tx_head = 0, tx_tail = 0;
+spin_lock_t *tx_lock;
+
+// Shared-state lock between core 1 (serial protocol) and core 0's frame and
+// VSYNC interrupts.  This is what hal_irq_save takes.
+spin_lock_t *core_lock;
+
+// Work core 1 hands to core 0, such as interrupt setup, which only affects
+// the core it runs on.  Single producer (core 1), single consumer (core 0).
+struct {
+    core0_op_t fn;
+    uint32_t arg;
+} core0_ops[CORE0_OP_LEN];
+uint32_t core0_op_head = 0, core0_op_tail = 0;
+
+// Core 1 runs the whole serial protocol, so it gets a larger stack
+uint32_t core1_stack[CORE1_STACK_WORDS];
+
+// Last HID report sent on each interface, and the frame it carried
+USB_ControllerReport_Input_t hid_sent_con[SWICC_PLAYERS];
+uint32_t hid_sent_seq[SWICC_PLAYERS];
+// Frame time of a report waiting to be collected by the host (player 0 only)
+uint64_t hid_pending_frame_us;
+bool hid_pending = false;
 
 //--------------------------------------------------------------------
 // Main
@@ -71,9 +93,14 @@ int main(void)
 {
     board_init();
 
+    core_lock = spin_lock_init(spin_lock_claim_unused(true));
+
     // zero-out the controller buffer
     buffer_init();
 
+    // Look for a movie in flash
+    movie_init();
+
     // Set up USB
     tusb_init();
 
@@ -88,17 +115,22 @@ int main(void)
     // Set up feedback neopixel
     ws2812_program_init(pio, 2, offset, 8, 800000, IS_RGBW);
 
-    // Start second core (handles the display)
-    multicore_launch_core1(core1_task);
+    // Let core 1 park this core while it writes to flash
+    multicore_lockout_victim_init();
+
+    // Start second core (handles the serial protocol and the display)
+    multicore_launch_core1_with_stack(core1_task, core1_stack, sizeof(core1_stack));
 
     // Start the free-running timer
     alarm_in_us(16667);
 
-    // Forever loop
+    // Forever loop.  Only USB and work handed over by core 1 run here;
+    // frames are driven by the timer and VSYNC interrupts.
     while (1)
     {
         tud_task(); // tinyusb device task
         hid_task();
+        core0_op_task();
     }
 
     return 0;
@@ -106,18 +138,62 @@ int main(void)
 
 void core1_task()
 {
+    uint64_t led_due_us = 0;
+
     while (1)
     {
-        if (led_on)
+        // Serial protocol: parsing, decoding and replies
+        uart_rx_task();
+        baud_task();
+        rec_live_task();
+        rec_dump_task();
+        movie_task();
+        macro_task();
+        vpll_task();
+        trace_task();
+
+        if (time_us_64() >= led_due_us)
         {
-            // Heartbeat
-            uint8_t hb = ((vsync_count % 64) == 0) * 4 | ((vsync_count % 64) == 11) * 32;
-            debug_pixel(urgb_u32(hb, 0, usb_connected * 16));
+            if (led_on)
+            {
+                // Heartbeat
+                uint8_t hb = ((vsync_count % 64) == 0) * 4 | ((vsync_count % 64) == 11) * 32;
+                debug_pixel(urgb_u32(hb, 0, usb_connected * 16));
+            }
+            else
+                debug_pixel(urgb_u32(0, 0, 0));
+
+            led_due_us = time_us_64() + LED_PERIOD_US;
         }
-        else
-            debug_pixel(urgb_u32(0, 0, 0));
+    }
+}
+
+/* Ask core 0 to run fn(arg) from its main loop.  Called from core 1; waits
+ *  only if earlier requests are still outstanding.
+ */
+void core0_call(core0_op_t fn, uint32_t arg)
+{
+    uint32_t head = core0_op_head;
+
+    while ((head - __atomic_load_n(&core0_op_tail, __ATOMIC_ACQUIRE)) >= CORE0_OP_LEN)
+        tight_loop_contents();
 
-        sleep_ms(5);
+    core0_ops[head % CORE0_OP_LEN].fn = fn;
+    core0_ops[head % CORE0_OP_LEN].arg = arg;
+    __atomic_store_n(&core0_op_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Run the work core 1 has handed over.
+ */
+void core0_op_task()
+{
+    uint32_t tail = core0_op_tail;
+
+    while (tail != __atomic_load_n(&core0_op_head, __ATOMIC_ACQUIRE))
+    {
+        core0_ops[tail % CORE0_OP_LEN].fn(core0_ops[tail % CORE0_OP_LEN].arg);
+        tail++;
+        __atomic_store_n(&core0_op_tail, tail, __ATOMIC_RELEASE);
     }
 }
 
@@ -153,11 +229,25 @@ void tud_resume_cb(void)
 }
 
 // Invoked when sent REPORT successfully to host
-// Nothing to do here, since there's only one report.
+// Completes the latency measurement of a frame's first report.  Latency and
+// VSYNC polling only follow player 0's interface.
 void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
 {
-    (void)instance;
+    (void)report;
     (void)len;
+
+    if (instance != 0)
+        return;
+
+    uint64_t now = time_us_64();
+    if (hid_pending)
+    {
+        uint32_t irq_state = hal_irq_save();
+        lat_add(&lat_complete, now - hid_pending_frame_us);
+        hal_irq_restore(irq_state);
+        hid_pending = false;
+    }
+    vpll_poll(now);
 }
 
 // Invoked when received GET_REPORT control request
@@ -176,60 +266,78 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 // USB HID
 //--------------------------------------------------------------------
 
-void hid_task(void)
+/* Send one player's report on its own HID interface.
+ */
+void hid_player_task(uint8_t n)
 {
+    player_t *p = &players[n];
+    USB_ControllerReport_Input_t con;
 
-    // report controller data
-    if (tud_hid_ready())
+    // Lagged states are let out here, not just on frames
+    lag_release(p);
+
+    if (!tud_hid_n_ready(n))
+        return;
+
+    switch (p->action_mode)
     {
-        switch (action_mode)
-        {
-        case A_PLAY: // play from buffer
-        case A_LAG:  // play from lag buffer
-        case A_RT:   // Real-time
-            tud_hid_report(0, &current_con, sizeof(USB_ControllerReport_Input_t));
-            break;
-        case A_STOP: // output neutral
-            tud_hid_report(0, &neutral_con, sizeof(USB_ControllerReport_Input_t));
-            break;
-
-        default:
-            break;
-        }
+    case A_PLAY:  // play from buffer
+    case A_LAG:   // play from lag buffer
+    case A_RT:    // Real-time
+    case A_MOVIE: // play from flash
+    case A_MACRO: // run a macro
+        con_read(p, &con);
+        break;
+    case A_STOP: // output neutral
+        memcpy(&con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        break;
+
+    default:
+        return;
     }
-}
 
-//--------------------------------------------------------------------
-// UART and buffer code
-//--------------------------------------------------------------------
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t seq = frame_seq;
+    uint64_t frame_us = frame_time_us;
+    restore_interrupts(irq_state);
 
-/* Initialize the buffer and other controller variables.
- */
-void buffer_init()
-{
-    // Set pointers
-    queue_tail = 0;
-    rec_head = 0;
-    stream_head = 0;
-    queue_head = 0;
-    // Configure a neutral controller state
-    neutral_con.LX = 128;
-    neutral_con.LY = 128;
-    neutral_con.RX = 128;
-    neutral_con.RY = 128;
-    neutral_con.HAT = 0x08;
-    neutral_con.Button = 0;
-
-    // Copy to initial controller state
-    memcpy(&current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
-
-    // Copy the neutral controller into all buffer entries
-    for (int i = 0; i < CON_BUFF_LEN; i++)
+#ifdef SWICC_LOW_LATENCY_HID
+    // Send once per frame, plus whenever the state changes between frames
+    if (seq == hid_sent_seq[n] && memcmp(&con, &hid_sent_con[n], sizeof(con)) == 0)
+        return;
+#endif
+
+    if (!tud_hid_n_report(n, 0, &con, sizeof(USB_ControllerReport_Input_t)))
+        return;
+
+    // Time the first report carrying each frame
+    if (n == 0 && seq != hid_sent_seq[n])
     {
-        memcpy(&(con_data_buff[i]), &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        uint64_t now = time_us_64();
+        irq_state = hal_irq_save();
+        lat_add(&lat_submit, now - frame_us);
+        hal_irq_restore(irq_state);
+        // seq already counts this frame; the trace numbers it from 0
+        trace_hid(seq - 1, now);
+        hid_pending_frame_us = frame_us;
+        hid_pending = true;
     }
+    hid_sent_seq[n] = seq;
+    memcpy(&hid_sent_con[n], &con, sizeof(USB_ControllerReport_Input_t));
 }
 
+void hid_task(void)
+{
+    for (uint8_t n = 0; n < SWICC_PLAYERS; n++)
+    {
+        hid_player_task(n);
+    }
+}
+
+//--------------------------------------------------------------------
+// UART code
+//--------------------------------------------------------------------
+
 void uart_setup()
 {
     // Set up UART with a basic baud rate.
@@ -243,432 +351,259 @@ void uart_setup()
     // Set data format
     uart_set_format(UART_ID, DATA_BITS, STOP_BITS, PARITY);
     // Turn on FIFO's
-    uart_set_fifo_enabled(UART_ID, false);
-    // Set up a RX interrupt
+    uart_set_fifo_enabled(UART_ID, true);
+    // No RX interrupt; received data is moved into the ring by DMA.
+    // The TX interrupt is switched on by uart_tx_kick when there is data.
+    uart_set_irq_enables(UART_ID, false, false);
+    tx_lock = spin_lock_init(spin_lock_claim_unused(true));
     int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
-    // And set up and enable the interrupt handlers
-    irq_set_exclusive_handler(UART_IRQ, on_uart_rx);
+    irq_set_exclusive_handler(UART_IRQ, on_uart_irq);
     irq_set_enabled(UART_IRQ, true);
-    // Eable the UART to send interrupts (on RX only)
-    uart_set_irq_enables(UART_ID, true, false);
+
+    // Set up a DMA channel to copy every received byte into the RX ring.
+    // The write address wraps on the ring size, so it runs indefinitely.
+    rx_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(rx_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, RX_RING_BITS);
+    channel_config_set_dreq(&c, uart_get_dreq(UART_ID, false));
+    dma_channel_configure(rx_dma_chan, &c, rx_ring, &uart_get_hw(UART_ID)->dr, RX_DMA_COUNT, true);
 }
 
-/* Each time a character is received, process it.
- *  Uses state in cmd_state to track what is happening.
+/* UART interrupt handler.
+ *  Only the TX interrupt is used; it refills the FIFO from the TX ring.
  */
-void on_uart_rx()
+void on_uart_irq()
 {
-    static int cmd_state = C_IDLE;
-    static char cmd_str[32];        // incoming command string
-    cmd_str[31] = 0;                // Ensure null termination
-    static uint8_t cmd_str_ind = 0; // index into command string
-
-    //    board_led_write(1);
-    while (uart_is_readable(UART_ID))
-    {
-        uint8_t ch = uart_getc(UART_ID);
-
-        // hard force new action on command character
-        if (ch == CMD_CHAR)
-        {
-            // reset command string
-            cmd_str_ind = 0;
-            memset(cmd_str, 0, 30); // Fill the string with null
-            uart_count = 0;
-        }
-        // parse the full command on newline
-        else if ((ch == '\r') || (ch == '\n'))
-        {
-
-            // ID self
-            if (strncmp(cmd_str, "ID ", 3) == 0)
-            {
-                uart_puts(UART_ID, "+SwiCC \r\n");
-            }
-
-            // Get version
-            if (strncmp(cmd_str, "VER ", 4) == 0)
-            {
-                uart_puts(UART_ID, "+VER 2.2\r\n");
-            }
-
-            // Add to queue
-            if (strncmp(cmd_str, "Q ", 2) == 0)
-            {
-                add_to_queue(cmd_str + 2);
-                // Assume that adding to the queue means the user wants to play the queue
-                action_mode = A_PLAY;
-            }
-
-            // Add to lagged queue
-            if (strncmp(cmd_str, "QL ", 3) == 0)
-            {
-                add_to_queue(cmd_str + 3);
-                // Assume that the user wants to play lagged
-                action_mode = A_LAG;
-            }
-
-            // Set the lag amount
-            if (strncmp(cmd_str, "SLAG ", 5) == 0)
-            {
-                uint8_t old_lag = lag_amount;
-                char *endptr;
-                cmd_str[8] = 32; // cap numerical amount at three digits
-                lag_amount = strtol(cmd_str + 5, &endptr, 10);
-                if (lag_amount > 120)
-                    lag_amount = 120;
-                // If lag amount is being reduced, catch up queue tail
-                if (lag_amount < old_lag)
-                {
-                    queue_tail = ((queue_head + CON_BUFF_LEN) - lag_amount) % CON_BUFF_LEN;
-                }
-            }
-
-            // Immediate command
-            if ((strncmp(cmd_str, "IMM ", 4) == 0))
-            {
-                force_con_state(cmd_str + 4);
-                // Reset queue
-                queue_head = 0;
-                queue_tail = 0;
-            }
-
-            // Set VSYNC delay
-            if (strncmp(cmd_str, "VSD ", 4) == 0)
-            {
-                set_frame_delay(cmd_str + 4);
-            }
-
-            // Start recording
-            if (strncmp(cmd_str, "REC ", 4) == 0)
-            {
-                if (cmd_str[4] == '1') {
-                    rec_head = 0;
-                    recording_wrap = false;
-                    memcpy(&(rec_data_buff[rec_head]), &current_con, sizeof(USB_ControllerReport_Input_t));
-                    rec_rle_buff[rec_head] = 1;
-                    recording = true;
-                } else {
-                    recording = false;
-                }
-            }
-
+    uint32_t irq_state = spin_lock_blocking(tx_lock);
+    uart_tx_kick();
+    spin_unlock(tx_lock, irq_state);
+}
 
-            // Get USB connection status
-            if (strncmp(cmd_str, "GCS ", 4) == 0)
-            {
-                if (usb_connected)
-                    uart_puts(UART_ID, "+GCS 1\r\n");
-                else
-                    uart_puts(UART_ID, "+GCS 0\r\n");
-            }
+/* Move as much of the TX ring as will fit into the UART FIFO.
+ *  The TX interrupt stays enabled only while there is more to send.
+ *  Must be called with tx_lock held.
+ */
+void uart_tx_kick()
+{
+    uart_hw_t *uart_hw = uart_get_hw(UART_ID);
 
-            // Get queue buffer fullness
-            if (strncmp(cmd_str, "GQF ", 4) == 0)
-            {
-                uart_resp_int("GQF", get_queue_fill());
-            }
+    while ((tx_tail != tx_head) && uart_is_writable(UART_ID))
+    {
+        uart_hw->dr = tx_ring[tx_tail & (TX_RING_LEN - 1)];
+        tx_tail++;
+    }
 
-            // Get recording buffer fullness
-            if (strncmp(cmd_str, "GRF ", 4) == 0)
-            {
-                // If recording has wrapped, it is full
-                if (recording_wrap) {
-                    uart_resp_int("GRF", (unsigned int)(REC_BUFF_LEN));
-                } else {
-                    uart_resp_int("GRF", (unsigned int)(rec_head));
-                }
-            }
-            // Get recording buffer remaining
-            if (strncmp(cmd_str, "GRR ", 4) == 0)
-            {
-                // If recording has wrapped, it is empty
-                if (recording_wrap) {
-                    uart_resp_int("GRR", (unsigned int)(0));
-                } else {
-                    uart_resp_int("GRR", (unsigned int)(REC_BUFF_LEN - rec_head));
-                }
-            }
-            // Get total recording buffer size
-            if (strncmp(cmd_str, "GRB ", 4) == 0)
-            {
-                // If recording has wrapped, it is empty
-                uart_resp_int("GRB", (unsigned int)(REC_BUFF_LEN));
-            }
+    if (tx_tail != tx_head)
+        hw_set_bits(&uart_hw->imsc, UART_UARTIMSC_TXIM_BITS);
+    else
+        hw_clear_bits(&uart_hw->imsc, UART_UARTIMSC_TXIM_BITS);
+}
 
-            // Retrieve recording
-            if (strncmp(cmd_str, "GR ", 3) == 0)
-            {
-                if (cmd_str[3] == '0') {
-                    // Start at beginning
-                    if (recording_wrap) {
-                        // If wrapped, oldest value is just in front of head
-                        stream_head = (rec_head + 1) % REC_BUFF_LEN;
-                    } else {
-                        stream_head = 0;
-                    }
-                }
-                send_recording();
-                if (stream_head == rec_head)
-                {
-                    // end of stream, entire recording has been sent
-                    uart_puts(UART_ID, "+GR 0\r\n");
-                }
-                else
-                {
-                    // end of stream but more is pending
-                    uart_puts(UART_ID, "+GR 1\r\n");
-                }
-            }
+/* Queue data for transmission without waiting.
+ *  Either all of the data is queued or none of it is.  Safe to call from
+ *  interrupts.  Returns false if there was not enough room.
+ */
+bool uart_tx_try_write(const uint8_t *data, size_t len)
+{
+    uint32_t irq_state = spin_lock_blocking(tx_lock);
 
-            // Enable / disable vsync synchronization
-            if (strncmp(cmd_str, "VSYNC ", 6) == 0)
-            {
-                if (cmd_str[6] == '1')
-                {
-                    vsync_en = true;
-                    // Set up GPIO interrupt
-                    gpio_set_irq_enabled_with_callback(VSYNC_IN_PIN, GPIO_IRQ_EDGE_RISE, true, &gpio_callback);
-                    vsync_count = 0;
-                }
-                else if (cmd_str[6] == '0')
-                {
-                    vsync_en = false;
-                    // Disable GPIO interrupt
-                    gpio_set_irq_enabled(VSYNC_IN_PIN, GPIO_IRQ_EDGE_RISE, false);
-                    alarm_in_us(16666); // set an alarm 1/60s in the future
-                }
-                else {
-                    if (vsync_en)
-                        uart_puts(UART_ID, "+VSYNC 1\r\n");
-                    else
-                        uart_puts(UART_ID, "+VSYNC 0\r\n");
-                }
-            }
+    if ((TX_RING_LEN - (tx_head - tx_tail)) < len)
+    {
+        spin_unlock(tx_lock, irq_state);
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        tx_ring[tx_head & (TX_RING_LEN - 1)] = data[i];
+        tx_head++;
+    }
+    uart_tx_kick();
 
-            // Enable / disable LED
-            if (strncmp(cmd_str, "LED ", 4) == 0)
-            {
-                if (cmd_str[4] == '1')
-                {
-                    led_on = true;
-                }
-                else
-                {
-                    led_on = false;
-                }
-            }
+    spin_unlock(tx_lock, irq_state);
+    return true;
+}
 
-            memset(cmd_str, 0, 30); // Clear command; if it wasn't valid, it never will be
+/* Queue data for transmission.
+ *  Only waits if the TX ring is full, so this must not be called from an
+ *  interrupt.
+ */
+void uart_tx_write(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t chunk = len < (TX_RING_LEN / 4) ? len : (TX_RING_LEN / 4);
+        if (uart_tx_try_write(data, chunk))
+        {
+            data += chunk;
+            len -= chunk;
         }
         else
         {
-            // add chars to the string
-            if (cmd_str_ind < (sizeof(cmd_str) - 1))
-            {
-                cmd_str[cmd_str_ind] = ch;
-                cmd_str_ind++;
-                uart_count++;
-            }
+            tight_loop_contents();
         }
     }
 }
 
-/* Respond with an integer encoded in hex, starting with + and a header, ending with newline.
+/* Queue a string for transmission.
  */
-void uart_resp_int(const char *header, unsigned int msg)
+void uart_tx_puts(const char *str)
 {
-    char msgstr[5];
-
-    sent_count++;
-
-    sprintf(msgstr, "%04X", msg);
-    if (uart_is_writable(UART_ID))
-    {
-        uart_putc(UART_ID, '+');
-        uart_puts(UART_ID, header);
-        uart_putc(UART_ID, ' ');
-        uart_puts(UART_ID, msgstr);
-        uart_putc(UART_ID, '\r');
-        uart_putc(UART_ID, '\n');
-    }
+    uart_tx_write((const uint8_t *)str, strlen(str));
 }
 
-/* Send an entry of the recording from the stream head
+/* Wait until everything queued has left the UART.
  */
-void send_recording_entry() {
-    char msgstr[5];
-
-    // Header
-    uart_putc(UART_ID, '+');
-    uart_putc(UART_ID, 'R');
-    uart_putc(UART_ID, ' ');
-
-    // Controller state
-    sprintf(msgstr, "%04X", rec_data_buff[stream_head].Button);
-    uart_puts(UART_ID, msgstr);
-
-    sprintf(msgstr, "%02X", rec_data_buff[stream_head].HAT);
-    uart_puts(UART_ID, msgstr);
-
-    sprintf(msgstr, "%02X", rec_data_buff[stream_head].LX);
-    uart_puts(UART_ID, msgstr);
+void uart_tx_flush()
+{
+    while (tx_tail != tx_head)
+        tight_loop_contents();
+    uart_tx_wait_blocking(UART_ID);
+}
 
-    sprintf(msgstr, "%02X", rec_data_buff[stream_head].LY);
-    uart_puts(UART_ID, msgstr);
+/* Process any characters that have arrived in the RX ring.
+ *  Called from the main loop, so command handling never runs in an interrupt.
+ */
+void uart_rx_task()
+{
+    // A UART overrun means the FIFO filled before DMA could empty it.
+    uart_hw_t *uart_hw = uart_get_hw(UART_ID);
+    if (uart_hw->rsr & UART_UARTRSR_OE_BITS)
+    {
+        rx_overrun_count++;
+        uart_hw->rsr = UART_UARTRSR_OE_BITS; // any write clears the error
+    }
 
-    sprintf(msgstr, "%02X", rec_data_buff[stream_head].RX);
-    uart_puts(UART_ID, msgstr);
+    // Re-arm the DMA if it ever runs out of transfers.  The write address is
+    // left alone so the ring position stays continuous.
+    if (!dma_channel_is_busy(rx_dma_chan))
+    {
+        rx_dma_base += RX_DMA_COUNT;
+        dma_channel_set_trans_count(rx_dma_chan, RX_DMA_COUNT, true);
+    }
 
-    sprintf(msgstr, "%02X", rec_data_buff[stream_head].RY);
-    uart_puts(UART_ID, msgstr);
+    // Total number of bytes written into the ring so far
+    uint32_t rx_written = rx_dma_base + (RX_DMA_COUNT - dma_hw->ch[rx_dma_chan].transfer_count);
 
-    // RLE count
-    uart_putc(UART_ID, 'x');
+    // If the DMA has lapped the parser, unread data was overwritten.
+    if ((rx_written - rx_read_count) > RX_RING_LEN)
+    {
+        rx_overrun_count++;
+        rx_read_count = rx_written - RX_RING_LEN;
+    }
 
-    sprintf(msgstr, "%02X", rec_rle_buff[stream_head]);
-    uart_puts(UART_ID, msgstr);
+    //    board_led_write(1);
+    while (rx_read_count != rx_written)
+    {
+        process_rx_char(rx_ring[rx_read_count & (RX_RING_LEN - 1)]);
+        rx_read_count++;
+    }
+}
 
-    // Termination
-    uart_putc(UART_ID, '\r');
-    uart_putc(UART_ID, '\n');
+//--------------------------------------------------------------------
+// Platform functions for the core logic (see swicc_hal.h)
+//--------------------------------------------------------------------
 
-}
-void send_recording()
+void hal_uart_write(const uint8_t *data, size_t len)
 {
+    uart_tx_write(data, len);
+}
 
-    for (uint8_t i = 0; i < 30 && stream_head != rec_head; i++)
-    {
-        send_recording_entry(stream_head);
-        stream_head = (stream_head + 1) % REC_BUFF_LEN;
-    }
-    // Send the current controller state if needed
-    if (stream_head == rec_head) {
-        send_recording_entry(stream_head);
-    }
+void hal_uart_puts(const char *str)
+{
+    uart_tx_puts(str);
 }
 
-/* Set a new amount of delay from VSYNC to controller data change.
- */
-int set_frame_delay(const char *cstr)
+bool hal_uart_try_write(const uint8_t *data, size_t len)
 {
-    for (uint8_t i = 0; i < 4; i++)
-    {
-        // error on any non-hex characters
-        if (!((cstr[i] >= '0' && cstr[i] <= '9') || (cstr[i] >= 'A' && cstr[i] <= 'F')))
-            return -1;
-    }
-    frame_delay_us = hex2int(cstr, 4);
-    return 0;
+    return uart_tx_try_write(data, len);
 }
 
-/* Add a new controller state to the buffer.
- *  Incoming data is a hex-encoded string.
+/* Change the UART baud rate once all queued output has been sent.
  */
-int add_to_queue(const char *cstr)
+void hal_set_baud(unsigned int rate)
 {
+    uart_tx_flush();
+    uart_set_baudrate(UART_ID, rate);
+}
 
-    for (uint8_t i = 0; i < 6; i++)
-    {
-        // error on any non-hex characters
-        if (!((cstr[i] >= '0' && cstr[i] <= '9') || (cstr[i] >= 'A' && cstr[i] <= 'F')))
-            return -1;
-    }
+unsigned int hal_rx_overruns(void)
+{
+    return rx_overrun_count;
+}
 
-    // If normal queueing, increment the head, wrapping if needed.  In lag mode,
-    // head stays the same.
-    if (action_mode == A_PLAY)
-        queue_head = (queue_head + 1) % CON_BUFF_LEN;
+uint64_t hal_time_us(void)
+{
+    return time_us_64();
+}
 
-    // Add the new data to the head
-    con_data_buff[queue_head].Button = hex2int(cstr + 0, 4);
-    con_data_buff[queue_head].HAT = hex2int(cstr + 4, 2);
+/* Shared state is guarded against both the frame interrupts and the other
+ *  core.  Not reentrant.
+ */
+uint32_t hal_irq_save(void)
+{
+    return spin_lock_blocking(core_lock);
+}
 
-    bool hasStick = true;
-    for (uint8_t i = 7; i < 14; i++)
-    {
-        // error on any non-hex characters
-        if (!((cstr[i] >= '0' && cstr[i] <= '9') || (cstr[i] >= 'A' && cstr[i] <= 'F')))
-            hasStick = false;
-    }
+void hal_irq_restore(uint32_t state)
+{
+    spin_unlock(core_lock, state);
+}
 
-    if (hasStick)
-    {
-        con_data_buff[queue_head].LX = hex2int(cstr + 6, 2);
-        con_data_buff[queue_head].LY = hex2int(cstr + 8, 2);
-        con_data_buff[queue_head].RX = hex2int(cstr + 10, 2);
-        con_data_buff[queue_head].RY = hex2int(cstr + 12, 2);
-    }
-    else
-    {
-        con_data_buff[queue_head].LX = 0x80;
-        con_data_buff[queue_head].LY = 0x80;
-        con_data_buff[queue_head].RX = 0x80;
-        con_data_buff[queue_head].RY = 0x80;
-    }
+uint32_t hal_movie_capacity(void)
+{
+    return MOVIE_FLASH_BYTES;
+}
 
-    return get_queue_fill();
+const uint8_t *hal_movie_data(void)
+{
+    return (const uint8_t *)(XIP_BASE + MOVIE_FLASH_OFFSET);
 }
 
-/* Returns the amount of space currently used in the playback buffer.
+/* Erase and program run with XIP disabled, so nothing may execute from flash
+ *  meanwhile: the other core is parked and interrupts are held off on this
+ *  one.  Called from core 1.
  */
-unsigned int get_queue_fill()
+void hal_movie_erase(uint32_t offset)
 {
-    // Account for the fact that the buffer wraps around.
-    if (queue_head >= queue_tail)
-    {
-        return (unsigned int)(queue_head - queue_tail);
-    }
-    else
-    {
-        return (unsigned int)(CON_BUFF_LEN - (queue_tail - queue_head));
-    }
+    multicore_lockout_start_blocking();
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_erase(MOVIE_FLASH_OFFSET + offset, FLASH_SECTOR_SIZE);
+    restore_interrupts(irq_state);
+    multicore_lockout_end_blocking();
 }
 
+void hal_movie_program(uint32_t offset, const uint8_t *page)
+{
+    multicore_lockout_start_blocking();
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_program(MOVIE_FLASH_OFFSET + offset, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq_state);
+    multicore_lockout_end_blocking();
+}
 
-/* Set a new forced controller state (aka an immediate state).
- *  Data is a hex-encoded string.
+/* The GPIO and timer interrupts belong to core 0, so switching happens there.
  */
-int force_con_state(const char *cstr)
+void hal_vsync_enable(bool en)
 {
-    for (uint8_t i = 0; i < 6; i++)
-    {
-        // error on any non-hex characters in mandatory bytes
-        if (!((cstr[i] >= '0' && cstr[i] <= '9') || (cstr[i] >= 'A' && cstr[i] <= 'F')))
-            return -1;
-    }
-
-    // Assume that writing an immediate means the user wants to enter a real-time mode
-    action_mode = A_RT;
-
-    // Write the data to the controller state variable.
-    current_con.Button = hex2int(cstr + 0, 4);
-    current_con.HAT = hex2int(cstr + 4, 2);
-
-    bool hasStick = true;
-    for (uint8_t i = 0; i < 14; i++)
-    {
-        // error on any non-hex characters
-        if (!((cstr[i] >= '0' && cstr[i] <= '9') || (cstr[i] >= 'A' && cstr[i] <= 'F')))
-            hasStick = false;
-    }
+    core0_call(vsync_enable_op, en);
+}
 
-    if (hasStick)
+void vsync_enable_op(uint32_t en)
+{
+    if (en)
     {
-        current_con.LX = hex2int(cstr + 6, 2);
-        current_con.LY = hex2int(cstr + 8, 2);
-        current_con.RX = hex2int(cstr + 10, 2);
-        current_con.RY = hex2int(cstr + 12, 2);
+        // Set up GPIO interrupt
+        gpio_set_irq_enabled_with_callback(VSYNC_IN_PIN, GPIO_IRQ_EDGE_RISE, true, &gpio_callback);
     }
     else
     {
-        current_con.LX = 0x80;
-        current_con.LY = 0x80;
-        current_con.RX = 0x80;
-        current_con.RY = 0x80;
+        // Disable GPIO interrupt
+        gpio_set_irq_enabled(VSYNC_IN_PIN, GPIO_IRQ_EDGE_RISE, false);
+        alarm_in_us(16666); // set an alarm 1/60s in the future
     }
-
-    return get_queue_fill();
 }
 
 //--------------------------------------------------------------------
@@ -680,71 +615,26 @@ int force_con_state(const char *cstr)
 */
 static void alarm_irq(void)
 {
+    uint32_t irq_state = spin_lock_blocking(core_lock);
+
     // Clear the alarm irq
     hw_clear_bits(&timer_hw->intr, 1u << 0);
+    // Note when this interrupt was due, before the alarm is re-armed
+    trace_target(timer_hw->alarm[0]);
     if (!vsync_en)
     {
         alarm_in_us(16667); // set an alarm 1/60s in the future
         vsync_count++;
     }
-
-    // If playing back, move the queue pointers and send the next entry
-    if (action_mode == A_PLAY)
-    {
-        // Increment tail as long as buffer isn't empty, wrapping when needed
-        if (queue_tail != queue_head)
-        {
-            queue_tail = (queue_tail + 1) % CON_BUFF_LEN;
-        }
-        // Copy the current entry to the USB data
-        memcpy(&current_con, &(con_data_buff[queue_tail]), sizeof(USB_ControllerReport_Input_t));
-    }
-    // If playing in lag mode, move the queue pointers and send the next entry.
-    else if (action_mode == A_LAG)
+    else
     {
-        unsigned int old_head = queue_head;
-        // Copy the current entry to the USB data
-        memcpy(&current_con, &(con_data_buff[queue_tail]), sizeof(USB_ControllerReport_Input_t));
-        // Increment the head pointer, and increment the tail if needed to maintain lag amount.
-        queue_head = (queue_head + 1) % CON_BUFF_LEN;
-        if (queue_tail < queue_head)
-        { // Head is not wrapped
-            if ((queue_head - queue_tail) > lag_amount)
-            { // lag at limit; tail needs to keep up
-                queue_tail = (queue_tail + 1) % CON_BUFF_LEN;
-            }
-        }
-        else
-        { // Head is wrapped; need to account for it.
-            if (((CON_BUFF_LEN + queue_head) - queue_tail) > lag_amount)
-            {
-                queue_tail = (queue_tail + 1) % CON_BUFF_LEN;
-            }
-        }
-        // Copy the old head data to the new head
-        memcpy(&(con_data_buff[queue_head]), &(con_data_buff[old_head]), sizeof(USB_ControllerReport_Input_t));
+        // Flywheel: schedule the next frame from the predicted edge
+        alarm_at_us(vpll_frame());
     }
 
-    // If recording, copy real-time buffer to record buffer
-    if (recording)
-    {
-        // Implement run-length encoding.
-        if ((rec_rle_buff[rec_head] < 240) && (are_cons_equal(rec_data_buff[rec_head], current_con))) {
-            // One more of the same
-            rec_rle_buff[rec_head] += 1;
-        } else {
-            // Controller data has changed, or max rle length reached.
-            // increment index
-            rec_head++;
-            if (rec_head == REC_BUFF_LEN) {
-                rec_head = 0;
-                recording_wrap = true;
-            }
-            // Copy to record buffer
-            memcpy(&(rec_data_buff[rec_head]), &current_con, sizeof(USB_ControllerReport_Input_t));
-            rec_rle_buff[rec_head] = 1;
-        }
-    }
+    frame_update();
+
+    spin_unlock(core_lock, irq_state);
 }
 
 /* Set up an alarm in the future.
@@ -765,6 +655,21 @@ static void alarm_in_us(uint32_t delay_us)
     timer_hw->alarm[0] = (uint32_t)target;
 }
 
+/* Set up an alarm at an absolute time.  0 means no alarm.
+ */
+static void alarm_at_us(uint64_t target_us)
+{
+    if (target_us == 0)
+        return;
+
+    // A time that has already passed would not fire until the timer wraps
+    uint64_t now = time_us_64();
+    if (target_us < now + ALARM_MIN_US)
+        target_us = now + ALARM_MIN_US;
+
+    alarm_in_us(target_us - now);
+}
+
 //--------------------------------------------------------------------
 // GPIO code
 //--------------------------------------------------------------------
@@ -773,9 +678,16 @@ static void alarm_in_us(uint32_t delay_us)
  */
 void gpio_callback(uint gpio, uint32_t events)
 {
-    // set up an interrupt in the future to change controller data
-    alarm_in_us(frame_delay_us);
+    // set up an interrupt in the future to change controller data,
+    // at the time the VSYNC tracker settles on
+    uint32_t irq_state = spin_lock_blocking(core_lock);
+
+    uint64_t now = time_us_64();
+    trace_edge(now);
+    alarm_at_us(vpll_edge(now));
     vsync_count++;
+
+    spin_unlock(core_lock, irq_state);
 }
 
 //--------------------------------------------------------------------
@@ -1,71 +1,10 @@
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include "ws2812.pio.h"
-
-// Controller HID report structure.
-typedef struct {
-	uint16_t Button; // 16 buttons;
-	uint8_t  HAT;    // HAT switch; one nibble w/ unused nibble
-	uint8_t  LX;     // Left  Stick X
-	uint8_t  LY;     // Left  Stick Y
-	uint8_t  RX;     // Right Stick X
-	uint8_t  RY;     // Right Stick Y
-	uint8_t  VendorSpec;
-} USB_ControllerReport_Input_t;
-
-// The output is structured as a mirror of the input.
-typedef struct {
-	uint16_t Button; // 16 buttons;
-	uint8_t  HAT;    // HAT switch; one nibble w/ unused nibble
-	uint8_t  LX;     // Left  Stick X
-	uint8_t  LY;     // Left  Stick Y
-	uint8_t  RX;     // Right Stick X
-	uint8_t  RY;     // Right Stick Y
-} USB_ControllerReport_Output_t;
-
-// Type Defines
-// Enumeration for controller buttons.
-typedef enum {
-	KEY_Y       = 0x01,
-	KEY_B       = 0x02,
-	KEY_A       = 0x04,
-	KEY_X       = 0x08,
-	KEY_L       = 0x10,
-	KEY_R       = 0x20,
-	KEY_ZL      = 0x40,
-	KEY_ZR      = 0x80,
-	KEY_SELECT  = 0x100,
-	KEY_START   = 0x200,
-	KEY_LCLICK  = 0x400,
-	KEY_RCLICK  = 0x800,
-	KEY_HOME    = 0x1000,
-	KEY_CAPTURE = 0x2000,
-} ControllerButtons_t;
-
-// Action state
-enum {
-	A_PLAY, // play from buffer
-	A_RT,   // real-time
-	A_LAG,  // lag
-	A_STOP  // stop
-};
-
-// Serial control information
-enum {
-    C_IDLE,        // nothing happening
-    C_ACTIVATED,   // activated by command character
-    C_Q,           // receiving a controller state for queue
-    C_I,           // receiving an immediate controller state
-	C_F,           // request for queue buffer fill amount
-	C_M,           // mode change
-	C_R,           // request to read from record buffer 
-	C_D            // receiving a new delay value
-};
-
-
-#define CMD_CHAR '+'
+#include "swicc_core.h"
 
 #define UART_ID uart0
-#define BAUD_RATE 115200
 #define DATA_BITS 8
 #define STOP_BITS 1
 #define PARITY    UART_PARITY_NONE
@@ -74,52 +13,47 @@ enum {
 #define VSYNC_IN_PIN 14
 
 #define ALARM_IRQ TIMER_IRQ_0
+// Shortest alarm that is sure to be armed before it is due
+#define ALARM_MIN_US 10
+
+// UART receive ring (filled by DMA)
+#define RX_RING_BITS 10
+#define RX_RING_LEN (1u << RX_RING_BITS)
+#define RX_DMA_COUNT 0xFFFFFFFFu
 
-#define CON_BUFF_LEN 256
-#define REC_BUFF_LEN 16384
+// UART transmit ring (drained by the TX interrupt)
+#define TX_RING_LEN 2048
+
+// Work queued from core 1 to core 0
+#define CORE0_OP_LEN 8
+typedef void (*core0_op_t)(uint32_t arg);
+
+#define CORE1_STACK_WORDS 2048
+#define LED_PERIOD_US 5000
+
+// Movie storage: the upper half of flash, well clear of the program image
+#define MOVIE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES / 2)
+#define MOVIE_FLASH_BYTES  (PICO_FLASH_SIZE_BYTES - MOVIE_FLASH_OFFSET)
 
 
 void core1_task(void);
+void core0_call(core0_op_t fn, uint32_t arg);
+void core0_op_task();
+void vsync_enable_op(uint32_t en);
+void hid_player_task(uint8_t n);
 void hid_task(void);
-void buffer_init();
-int set_frame_delay(const char* cstr);
-int add_to_queue(const char* cstr);
-int force_con_state(const char* cstr);
-unsigned int get_queue_fill();
-unsigned int get_recording_fill();
 void uart_setup();
-void on_uart_rx();
-void uart_resp_int(const char* header, unsigned int msg);
-void send_recording();
+void uart_rx_task();
+void on_uart_irq();
+void uart_tx_kick();
+bool uart_tx_try_write(const uint8_t* data, size_t len);
+void uart_tx_write(const uint8_t* data, size_t len);
+void uart_tx_puts(const char* str);
+void uart_tx_flush();
 static void alarm_in_us(uint32_t delay_us);
+static void alarm_at_us(uint64_t target_us);
 void gpio_callback(uint gpio, uint32_t events);
 
-// Convert 1-4 hex characters into an int in a super unsafe way.
-int hex2int(const char* ch, uint8_t num) {
-	if ( (num<1) || (num>4) ) return -1;
-	int val = 0, tval = 0;
-	// Convert hex digits to number
-	for (uint8_t i=0; i<num; i++) {
-		val = val<<4;     // Shift to next nibble
-		tval = ch[i]-'0'; // Convert ascii number to its value
-		if (tval > 9) tval -= ('A'-'0'-10); // Convert A-F
-		val += tval;
-	}
-	return val;
-}
-
-// Compare two instances of the USB_ControllerReport_Input_t structure
-bool are_cons_equal(USB_ControllerReport_Input_t a, USB_ControllerReport_Input_t b) {
-    if (a.Button != b.Button) return false;
-    if (a.HAT != b.HAT) return false;
-    if (a.LX != b.LX) return false;
-    if (a.LY != b.LY) return false;
-    if (a.RX != b.RX) return false;
-    if (a.RY != b.RY) return false;
-    if (a.VendorSpec != b.VendorSpec) return false;
-    return true;
-}
-
 //--------------------------------------------------------------------
 // NeoPixel control
 //--------------------------------------------------------------------
@@ -0,0 +1,341 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/gpio.h"
+#include "bsp/board.h"
+#include "tusb.h"
+
+#include "SwiCC_Bridge.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+// UART receive ring.  DMA writes every received byte here; the main loop
+// passes it on to USB.
+uint8_t rx_ring[RX_RING_LEN] __attribute__((aligned(RX_RING_LEN)));
+int rx_dma_chan;
+uint32_t rx_dma_base = 0;   // bytes written by previous DMA runs
+uint32_t rx_read_count = 0; // bytes passed on to USB
+
+// UART transmit ring.  The main loop adds to the head, the TX interrupt
+// takes from the tail.
+uint8_t tx_ring[TX_RING_LEN];
+volatile uint32_t tx_head = 0, tx_tail = 0;
+
+uint32_t uart_baud = BAUD_RATE;
+bridge_stats_t stats;
+
+//--------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------
+
+int main(void)
+{
+    board_init();
+
+    // Set up USB
+    tusb_init();
+
+    // start serial comms
+    uart_setup();
+
+    // Forever loop.  Each pass moves whatever has arrived in either
+    // direction straight away, so nothing waits for a buffer to fill.
+    while (1)
+    {
+        tud_task(); // tinyusb device task
+        usb_to_uart_task();
+        uart_to_usb_task();
+        stats_task();
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------
+// USB to UART
+//--------------------------------------------------------------------
+
+/* Pass data from the host to SwiCC.
+ *  Only as much as the TX ring can hold is read; the rest stays in tinyusb,
+ *  which holds the host off until there is room.
+ */
+void usb_to_uart_task()
+{
+    uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE];
+
+    while (tud_cdc_n_available(ITF_DATA))
+    {
+        uint32_t space = TX_RING_LEN - (tx_head - tx_tail);
+        uint32_t len = space < sizeof(buf) ? space : sizeof(buf);
+        if (len == 0)
+            return;
+
+        len = tud_cdc_n_read(ITF_DATA, buf, len);
+        stats.usb_to_uart += uart_tx_try_write(buf, len);
+    }
+}
+
+//--------------------------------------------------------------------
+// UART to USB
+//--------------------------------------------------------------------
+
+/* Pass data from SwiCC to the host.
+ *  Whatever has arrived is flushed at once, so a short reply goes out in the
+ *  next USB frame rather than waiting for a full packet.
+ */
+void uart_to_usb_task()
+{
+    uart_hw_t *uart_hw = uart_get_hw(UART_ID);
+
+    // Count and clear receive errors
+    uint32_t rsr = uart_hw->rsr;
+    if (rsr)
+    {
+        if (rsr & UART_UARTRSR_OE_BITS)
+            stats.rx_overruns++;
+        if (rsr & UART_UARTRSR_FE_BITS)
+            stats.rx_framing++;
+        if (rsr & UART_UARTRSR_BE_BITS)
+            stats.rx_breaks++;
+        uart_hw->rsr = rsr; // any write clears the errors
+    }
+
+    // Re-arm the DMA if it ever runs out of transfers.  The write address is
+    // left alone so the ring position stays continuous.
+    if (!dma_channel_is_busy(rx_dma_chan))
+    {
+        rx_dma_base += RX_DMA_COUNT;
+        dma_channel_set_trans_count(rx_dma_chan, RX_DMA_COUNT, true);
+    }
+
+    // Total number of bytes written into the ring so far
+    uint32_t rx_written = rx_dma_base + (RX_DMA_COUNT - dma_hw->ch[rx_dma_chan].transfer_count);
+    uint32_t fill = rx_written - rx_read_count;
+
+    // Nowhere to send it until the host has set the device up
+    if (!tud_mounted())
+    {
+        rx_read_count = rx_written;
+        return;
+    }
+
+    // If the DMA has lapped the reader, unread data was overwritten.
+    if (fill > RX_RING_LEN)
+    {
+        stats.rx_dropped += fill - RX_RING_LEN;
+        rx_read_count = rx_written - RX_RING_LEN;
+        fill = RX_RING_LEN;
+    }
+    if (fill > stats.rx_max_fill)
+        stats.rx_max_fill = fill;
+    if (fill == 0)
+        return;
+
+    // Copy up to the end of the ring, then from the start if it wrapped
+    uint32_t sent = 0;
+    while (sent < fill)
+    {
+        uint32_t pos = rx_read_count & (RX_RING_LEN - 1);
+        uint32_t len = fill - sent;
+        if (len > RX_RING_LEN - pos)
+            len = RX_RING_LEN - pos;
+
+        uint32_t n = tud_cdc_n_write(ITF_DATA, &rx_ring[pos], len);
+        rx_read_count += n;
+        sent += n;
+        if (n < len)
+            break; // tinyusb's FIFO is full; try again next pass
+    }
+
+    stats.uart_to_usb += sent;
+    if (sent > 0)
+    {
+        tud_cdc_n_write_flush(ITF_DATA);
+        stats.usb_writes++;
+    }
+}
+
+/* Follow the host's line settings, so a baud change on the host side (for
+ *  example after SwiCC's BAUD command) carries through to the UART.  Output
+ *  already queued at the old settings is sent first.
+ */
+void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *p_line_coding)
+{
+    if (itf != ITF_DATA)
+        return;
+
+    static const uart_parity_t parities[] = {UART_PARITY_NONE, UART_PARITY_ODD, UART_PARITY_EVEN};
+    uint8_t parity = p_line_coding->parity < 3 ? p_line_coding->parity : 0;
+    uint8_t stop_bits = p_line_coding->stop_bits == 2 ? 2 : 1; // 0 = 1, 1 = 1.5, 2 = 2
+    uint8_t data_bits = p_line_coding->data_bits;
+    if (data_bits < 5 || data_bits > 8)
+        data_bits = 8;
+
+    uart_tx_drain(LINE_CHANGE_TIMEOUT_US);
+    uart_baud = uart_set_baudrate(UART_ID, p_line_coding->bit_rate);
+    uart_set_format(UART_ID, data_bits, stop_bits, parities[parity]);
+}
+
+//--------------------------------------------------------------------
+// UART code
+//--------------------------------------------------------------------
+
+void uart_setup()
+{
+    // Set up UART with a basic baud rate.
+    uart_init(UART_ID, BAUD_RATE);
+    gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+    uart_set_hw_flow(UART_ID, false, false);
+    uart_set_format(UART_ID, 8, 1, UART_PARITY_NONE);
+    uart_set_fifo_enabled(UART_ID, true);
+    // No RX interrupt; received data is moved into the ring by DMA.
+    // The TX interrupt is switched on by uart_tx_kick when there is data.
+    uart_set_irq_enables(UART_ID, false, false);
+    int UART_IRQ = UART_ID == uart0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(UART_IRQ, on_uart_irq);
+    irq_set_enabled(UART_IRQ, true);
+
+    // Set up a DMA channel to copy every received byte into the RX ring.
+    // The write address wraps on the ring size, so it runs indefinitely.
+    rx_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(rx_dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, RX_RING_BITS);
+    channel_config_set_dreq(&c, uart_get_dreq(UART_ID, false));
+    dma_channel_configure(rx_dma_chan, &c, rx_ring, &uart_get_hw(UART_ID)->dr, RX_DMA_COUNT, true);
+}
+
+/* UART interrupt handler.
+ *  Only the TX interrupt is used; it refills the FIFO from the TX ring.
+ */
+void on_uart_irq()
+{
+    uart_tx_kick();
+}
+
+/* Move as much of the TX ring as will fit into the UART FIFO.
+ *  The TX interrupt stays enabled only while there is more to send.  Called
+ *  from the interrupt, or with interrupts disabled.
+ */
+void uart_tx_kick()
+{
+    uart_hw_t *uart_hw = uart_get_hw(UART_ID);
+
+    while ((tx_tail != tx_head) && uart_is_writable(UART_ID))
+    {
+        uart_hw->dr = tx_ring[tx_tail & (TX_RING_LEN - 1)];
+        tx_tail++;
+    }
+
+    if (tx_tail != tx_head)
+        hw_set_bits(&uart_hw->imsc, UART_UARTIMSC_TXIM_BITS);
+    else
+        hw_clear_bits(&uart_hw->imsc, UART_UARTIMSC_TXIM_BITS);
+}
+
+/* Queue as much data for transmission as fits, without waiting.
+ *  Returns the number of bytes queued.
+ */
+size_t uart_tx_try_write(const uint8_t *data, size_t len)
+{
+    uint32_t irq_state = save_and_disable_interrupts();
+
+    size_t space = TX_RING_LEN - (tx_head - tx_tail);
+    if (len > space)
+        len = space;
+    for (size_t i = 0; i < len; i++)
+    {
+        tx_ring[tx_head & (TX_RING_LEN - 1)] = data[i];
+        tx_head++;
+    }
+    uart_tx_kick();
+
+    restore_interrupts(irq_state);
+    return len;
+}
+
+/* Wait, up to a limit, until everything queued has left the UART.
+ */
+void uart_tx_drain(uint32_t timeout_us)
+{
+    uint64_t deadline = time_us_64() + timeout_us;
+
+    while ((tx_tail != tx_head) && (time_us_64() < deadline))
+        tight_loop_contents();
+    while ((uart_get_hw(UART_ID)->fr & UART_UARTFR_BUSY_BITS) && (time_us_64() < deadline))
+        tight_loop_contents();
+}
+
+//--------------------------------------------------------------------
+// Statistics console
+//--------------------------------------------------------------------
+
+/* Handle the statistics console on the second CDC interface.
+ *  "s" (or Enter) prints the counters; "z" prints and then clears
+ *  them.
+ */
+void stats_task()
+{
+    while (tud_cdc_n_available(ITF_STATS))
+    {
+        int ch = tud_cdc_n_read_char(ITF_STATS);
+
+        if (ch == 's' || ch == 'S' || ch == '\r')
+            stats_send();
+        else if (ch == 'z' || ch == 'Z')
+        {
+            stats_send();
+            memset(&stats, 0, sizeof(stats));
+        }
+    }
+}
+
+/* Print the counters, in decimal, on the statistics console.
+ */
+void stats_send()
+{
+    char msgstr[200];
+
+    int len = snprintf(msgstr, sizeof(msgstr),
+                       "baud %lu usb>uart %lu uart>usb %lu writes %lu overrun %lu dropped %lu framing %lu break %lu rxmax %lu\r\n",
+                       (unsigned long)uart_baud,
+                       (unsigned long)stats.usb_to_uart, (unsigned long)stats.uart_to_usb,
+                       (unsigned long)stats.usb_writes, (unsigned long)stats.rx_overruns,
+                       (unsigned long)stats.rx_dropped, (unsigned long)stats.rx_framing,
+                       (unsigned long)stats.rx_breaks, (unsigned long)stats.rx_max_fill);
+    tud_cdc_n_write(ITF_STATS, msgstr, len);
+    tud_cdc_n_write_flush(ITF_STATS);
+}
@@ -0,0 +1,80 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_BRIDGE_H_
+#define SWICC_BRIDGE_H_
+
+/* USB-UART bridge for the recommended two-board assembly.
+ *  CDC interface 0 carries the link to SwiCC; interface 1 is a small console
+ *  that reports the bridge's counters.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UART_ID uart0
+#define UART_TX_PIN 0
+#define UART_RX_PIN 1
+#define BAUD_RATE 115200
+
+// CDC interfaces
+#define ITF_DATA  0
+#define ITF_STATS 1
+
+// UART receive ring (filled by DMA).  At 3 Mbaud this holds ~27 ms of data
+// while USB catches up.
+#define RX_RING_BITS 13
+#define RX_RING_LEN (1u << RX_RING_BITS)
+#define RX_DMA_COUNT 0xFFFFFFFFu
+
+// UART transmit ring (drained by the TX interrupt)
+#define TX_RING_LEN 4096
+
+// Longest wait for queued output before changing the line settings
+#define LINE_CHANGE_TIMEOUT_US 100000
+
+// Traffic and error counters, reported on the statistics console
+typedef struct {
+    uint32_t usb_to_uart;   // bytes from the host sent to SwiCC
+    uint32_t uart_to_usb;   // bytes from SwiCC sent to the host
+    uint32_t usb_writes;    // USB IN flushes
+    uint32_t rx_overruns;   // UART FIFO overruns (DMA fell behind)
+    uint32_t rx_dropped;    // bytes lost because the RX ring was lapped
+    uint32_t rx_framing;    // framing errors
+    uint32_t rx_breaks;     // break conditions
+    uint32_t rx_max_fill;   // most bytes ever waiting in the RX ring
+} bridge_stats_t;
+
+void uart_setup();
+void on_uart_irq();
+void uart_tx_kick();
+size_t uart_tx_try_write(const uint8_t* data, size_t len);
+void uart_tx_drain(uint32_t timeout_us);
+void usb_to_uart_task();
+void uart_to_usb_task();
+void stats_task();
+void stats_send();
+
+#endif /* SWICC_BRIDGE_H_ */
@@ -0,0 +1,2018 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swicc_core.h"
+#include "swicc_frame.h"
+#include "swicc_rec.h"
+#include "swicc_movie.h"
+#include "swicc_vsync.h"
+#include "swicc_trace.h"
+#include "swicc_sched.h"
+#include "swicc_macro.h"
+#include "swicc_hal.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+// Neutral controller state, shared by all players
+USB_ControllerReport_Input_t neutral_con;
+
+// One set of queues, recording and mode per controller.  Serial commands act
+// on cmd_player, which is chosen with the P command.
+player_t players[SWICC_PLAYERS];
+player_t *cmd_player = &players[0];
+
+_Static_assert((CON_BUFF_LEN & CON_BUFF_MASK) == 0, "CON_BUFF_LEN must be a power of two");
+
+// Bulk binary dump of a recording
+bool dump_active = false;
+player_t *dump_player;          // whose recording is being dumped
+unsigned int dump_pos;          // next ring position to send
+uint32_t dump_ring_left;        // ring bytes still to send
+uint8_t dump_extra[REC_MAX_RECORD]; // the unfinished run, sent after the ring data
+uint8_t dump_extra_len, dump_extra_sent;
+uint32_t dump_credits;
+uint16_t dump_seq;
+uint16_t dump_crc;
+uint32_t dump_total;
+
+// VSYNC timing
+unsigned int frame_delay_us = 10000;
+bool vsync_en = false;
+
+// State variables
+bool usb_connected = false;
+bool led_on = true;
+uint8_t vsync_count = 0;
+uint8_t uart_count = 0;
+uint8_t sent_count = 0;
+
+// Binary protocol
+bool binary_mode = false;
+swf_decoder_t frame_dec;
+uint16_t frame_err_count = 0;
+
+// Baud rate negotiation
+unsigned int baud_rate = BAUD_RATE;
+bool baud_pending = false;       // waiting for the host to confirm a new rate
+uint64_t baud_deadline_us = 0;   // revert to BAUD_RATE if not confirmed by now
+const unsigned int baud_rates[] = {115200, 230400, 460800, 921600, 1000000, 1500000, 2000000, 3000000};
+
+// Frame timing for HID latency measurement.  frame_seq counts frame updates
+// and frame_time_us is when the latest one finished.
+volatile uint32_t frame_seq = 0;
+volatile uint64_t frame_time_us = 0;
+// Frame update to report queued (submit) and to report collected by the host
+lat_stat_t lat_submit, lat_complete;
+
+//--------------------------------------------------------------------
+// Buffer code
+//--------------------------------------------------------------------
+
+/* Index of a player, as used by the P command.
+ */
+unsigned int player_index(const player_t *p)
+{
+    return p - players;
+}
+
+/* Suffix for asynchronous notices, so the host can tell which player they are
+ *  about.  Player 0 has none, which keeps single-controller output unchanged.
+ */
+const char *player_suffix(const player_t *p)
+{
+    static const char *const suffix[] = {"", "1", "2", "3"};
+    return suffix[player_index(p)];
+}
+
+/* Initialize the buffer and other controller variables.
+ */
+void buffer_init()
+{
+    // Configure a neutral controller state
+    neutral_con.LX = 128;
+    neutral_con.LY = 128;
+    neutral_con.RX = 128;
+    neutral_con.RY = 128;
+    neutral_con.HAT = 0x08;
+    neutral_con.Button = 0;
+
+    for (int n = 0; n < SWICC_PLAYERS; n++)
+    {
+        player_t *p = &players[n];
+
+        // Set pointers
+        p->queue_tail = 0;
+        p->queue_head = 0;
+        p->lag_tail = 0;
+        p->lag_head = 0;
+        p->rec_head = 0;
+        p->rec_tail = 0;
+        p->rec_used = 0;
+        p->stream_pos = 0;
+        p->stream_left = 0;
+        p->stream_open = false;
+        p->action_mode = A_PLAY;
+        p->queue_low_armed = true;
+        p->queue_high_armed = true;
+
+        // Copy to initial controller state
+        memcpy(&p->current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        con_publish(p);
+
+        // Copy the neutral controller into all buffer entries
+        for (int i = 0; i < CON_BUFF_LEN; i++)
+        {
+            memcpy(&(p->con_data_buff[i]), &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        }
+        for (int i = 0; i < LAG_BUFF_LEN; i++)
+        {
+            p->lag_buff[i].con = neutral_con;
+            p->lag_buff[i].stamp_us = 0;
+        }
+    }
+}
+
+//--------------------------------------------------------------------
+// Command parsing
+//--------------------------------------------------------------------
+
+/* Process one received character.
+ *  Text commands are collected until a newline and then executed; in binary
+ *  mode, characters go to the frame decoder instead.
+ */
+void process_rx_char(uint8_t ch)
+{
+    static char cmd_str[CMD_STR_LEN]; // incoming command string
+    cmd_str[CMD_STR_LEN - 1] = 0;     // Ensure null termination
+    static uint8_t cmd_str_ind = 0; // index into command string
+
+    // In binary mode, everything goes to the frame decoder
+    if (binary_mode)
+    {
+        int frame_len = swf_decode_byte(&frame_dec, ch);
+        if (frame_len > 0)
+        {
+            process_frame(frame_dec.buf, frame_len);
+        }
+        else if (frame_len == SWF_ERROR)
+        {
+            frame_err_count++;
+            send_frame_int(BOP_NAK, frame_err_count);
+        }
+        return;
+    }
+
+    // hard force new action on command character
+    if (ch == CMD_CHAR)
+    {
+        // reset command string
+        cmd_str_ind = 0;
+        memset(cmd_str, 0, sizeof(cmd_str)); // Fill the string with null
+        uart_count = 0;
+    }
+    // parse the full command on newline
+    else if ((ch == '\r') || (ch == '\n'))
+    {
+        process_command(cmd_str);
+        memset(cmd_str, 0, sizeof(cmd_str)); // Clear command; if it wasn't valid, it never will be
+    }
+    else
+    {
+        // add chars to the string
+        if (cmd_str_ind < (sizeof(cmd_str) - 1))
+        {
+            cmd_str[cmd_str_ind] = ch;
+            cmd_str_ind++;
+            uart_count++;
+        }
+    }
+}
+
+/* Text command handlers.  Each is passed the text after the space that
+ *  follows the command name.
+ */
+
+// ID self
+static void cmd_id(char *arg)
+{
+    (void)arg;
+    hal_uart_puts("+SwiCC \r\n");
+}
+
+// Get version
+static void cmd_ver(char *arg)
+{
+    (void)arg;
+    hal_uart_puts("+VER 2.2\r\n");
+}
+
+// Add to queue
+static void cmd_q(char *arg)
+{
+    player_t *p = cmd_player;
+    add_to_queue(p, arg);
+    // Assume that adding to the queue means the user wants to play the queue
+    p->action_mode = A_PLAY;
+}
+
+// Add a batch of states to the queue
+static void cmd_qb(char *arg)
+{
+    queue_batch(cmd_player, arg);
+}
+
+// Add to lagged queue
+static void cmd_ql(char *arg)
+{
+    player_t *p = cmd_player;
+    add_to_lag(p, arg);
+    // Assume that the user wants to play lagged
+    p->action_mode = A_LAG;
+}
+
+// Set the lag amount in frames
+static void cmd_slag(char *arg)
+{
+    char *endptr;
+    arg[3] = 32; // cap numerical amount at three digits
+    set_lag_us(cmd_player, strtoul(arg, &endptr, 10) * VPLL_NOMINAL_US);
+}
+
+// Set the lag amount in microseconds
+static void cmd_slagu(char *arg)
+{
+    char *endptr;
+    arg[8] = 32; // cap numerical amount at eight digits
+    set_lag_us(cmd_player, strtoul(arg, &endptr, 10));
+}
+
+// Immediate command
+static void cmd_imm(char *arg)
+{
+    player_t *p = cmd_player;
+    if (force_con_state(p, arg) >= 0)
+    {
+        // Reset queue
+        queue_clear(p);
+    }
+}
+
+// Set VSYNC delay
+static void cmd_vsd(char *arg)
+{
+    set_frame_delay(arg);
+}
+
+// Start recording
+static void cmd_rec(char *arg)
+{
+    player_t *p = cmd_player;
+    // The frame interrupt writes the same ring, so keep it out throughout
+    uint32_t irq_state = hal_irq_save();
+    if (arg[0] == '1') {
+        p->rec_live = false;
+        rec_start(p);
+    } else if (arg[0] == '2') {
+        // Record and stream each run to the host as it finishes
+        p->rec_live = true;
+        p->rec_live_lost = 0;
+        rec_start(p);
+    } else if (p->recording) {
+        p->recording = false;
+        if (p->rec_live) {
+            // Hand over the final run; rec_live_task sends it
+            rec_close_run(p);
+            p->rec_run = 0;
+        }
+    }
+    hal_irq_restore(irq_state);
+}
+
+// Get USB connection status
+static void cmd_gcs(char *arg)
+{
+    (void)arg;
+    if (usb_connected)
+        hal_uart_puts("+GCS 1\r\n");
+    else
+        hal_uart_puts("+GCS 0\r\n");
+}
+
+// Get the frame counter (the number of the next frame to be produced)
+static void cmd_gfc(char *arg)
+{
+    (void)arg;
+    char msgstr[20];
+
+    sprintf(msgstr, "+GFC %08lX\r\n", (unsigned long)frame_seq);
+    hal_uart_puts(msgstr);
+}
+
+// Get UART receive overrun count
+static void cmd_gov(char *arg)
+{
+    (void)arg;
+    uart_resp_int("GOV", hal_rx_overruns());
+}
+
+// Get queue buffer fullness
+static void cmd_gqf(char *arg)
+{
+    (void)arg;
+    uart_resp_int("GQF", get_queue_fill(cmd_player));
+}
+
+// Set the queue low and high watermarks
+static void cmd_qwm(char *arg)
+{
+    player_t *p = cmd_player;
+    char *end;
+    int low = strtoul(arg, &end, 16);
+    int high = strtoul(end, NULL, 16);
+    set_queue_marks(p, low, high);
+    char msgstr[20];
+    sprintf(msgstr, "+QWM %04X %04X\r\n", p->queue_low_mark, p->queue_high_mark);
+    hal_uart_puts(msgstr);
+}
+
+// Get number of states refused because the queue was full
+static void cmd_gqr(char *arg)
+{
+    (void)arg;
+    uart_resp_int("GQR", cmd_player->queue_rejected);
+}
+
+// Get recording buffer fullness
+static void cmd_grf(char *arg)
+{
+    (void)arg;
+    player_t *p = cmd_player;
+    // If recording has wrapped, it is full
+    if (p->recording_wrap) {
+        uart_resp_long("GRF", (unsigned int)(REC_BUFF_BYTES));
+    } else {
+        uart_resp_long("GRF", (unsigned int)(p->rec_used));
+    }
+}
+
+// Get recording buffer remaining
+static void cmd_grr(char *arg)
+{
+    (void)arg;
+    player_t *p = cmd_player;
+    // If recording has wrapped, it is empty
+    if (p->recording_wrap) {
+        uart_resp_long("GRR", (unsigned int)(0));
+    } else {
+        uart_resp_long("GRR", (unsigned int)(REC_BUFF_BYTES - p->rec_used));
+    }
+}
+
+// Get total recording buffer size
+static void cmd_grb(char *arg)
+{
+    (void)arg;
+    uart_resp_long("GRB", (unsigned int)(REC_BUFF_BYTES));
+}
+
+// Retrieve recording
+static void cmd_gr(char *arg)
+{
+    player_t *p = cmd_player;
+    if (arg[0] == '0') {
+        // Start at the oldest record
+        uint32_t irq_state = hal_irq_save();
+        p->stream_pos = p->rec_tail;
+        memcpy(p->stream_state, p->rec_base, SWF_CON_LEN);
+        p->stream_left = 0;
+        p->stream_open = false;
+        hal_irq_restore(irq_state);
+    }
+    send_recording(p);
+    if ((p->stream_left == 0) && (p->stream_pos == p->rec_head) && (p->stream_open || p->rec_run == 0))
+    {
+        // end of stream, entire recording has been sent
+        hal_uart_puts("+GR 0\r\n");
+    }
+    else
+    {
+        // end of stream but more is pending
+        hal_uart_puts("+GR 1\r\n");
+    }
+}
+
+// Enable / disable vsync synchronization
+static void cmd_vsync(char *arg)
+{
+    if (arg[0] == '1')
+    {
+        vpll_reset();
+        vsync_en = true;
+        hal_vsync_enable(true);
+        vsync_count = 0;
+    }
+    else if (arg[0] == '0')
+    {
+        vsync_en = false;
+        hal_vsync_enable(false);
+    }
+    else {
+        if (vsync_en)
+            hal_uart_puts("+VSYNC 1\r\n");
+        else
+            hal_uart_puts("+VSYNC 0\r\n");
+    }
+}
+
+// Start uploading a movie, relative to the given base state
+static void cmd_mvb(char *arg)
+{
+    USB_ControllerReport_Input_t con;
+    uint8_t base[SWF_CON_LEN];
+    char msgstr[20];
+
+    if (parse_con_state(arg, &con) >= 0)
+    {
+        pack_con(&con, base);
+        sprintf(msgstr, "+MVB %08X\r\n", (unsigned int)movie_begin(base));
+        hal_uart_puts(msgstr);
+    }
+}
+
+// Add hex-encoded record data to the movie being uploaded
+static void cmd_mvw(char *arg)
+{
+    uint8_t data[(CMD_STR_LEN - 4) / 2];
+    char msgstr[20];
+
+    // the data stops at the first non-hex character
+    size_t len = hex_decode(arg, data, sizeof(data));
+
+    int written = movie_write(data, len);
+    if (written < 0)
+        hal_uart_puts("+MVW ERR\r\n");
+    else
+    {
+        sprintf(msgstr, "+MVW %08X\r\n", (unsigned int)written);
+        hal_uart_puts(msgstr);
+    }
+}
+
+// Finish a movie upload, checking the data against the host's CRC
+static void cmd_mvc(char *arg)
+{
+    uint8_t crc[2];
+    uint16_t actual;
+    char msgstr[24];
+
+    if (hex_decode(arg, crc, 2) < 2)
+    {
+        // leave the upload open so the host can try again
+        hal_uart_puts("+MVC ERR\r\n");
+        return;
+    }
+
+    if (movie_commit((crc[0] << 8) | crc[1], &actual))
+        sprintf(msgstr, "+MVC OK %08X\r\n", (unsigned int)movie_len);
+    else
+        sprintf(msgstr, "+MVC ERR %04X\r\n", actual);
+    hal_uart_puts(msgstr);
+}
+
+// Play or stop the movie
+static void cmd_mvp(char *arg)
+{
+    if (arg[0] == '0')
+    {
+        movie_stop();
+        hal_uart_puts("+MVP 0\r\n");
+    }
+    else if (movie_play(cmd_player))
+        hal_uart_puts("+MVP 1\r\n");
+    else
+        hal_uart_puts("+MVP ERR\r\n");
+}
+
+// Get movie status, length and playback position
+static void cmd_gmv(char *arg)
+{
+    (void)arg;
+    char msgstr[32];
+    sprintf(msgstr, "+GMV %u %08X %08X\r\n", movie_get_status(),
+            (unsigned int)movie_len, (unsigned int)movie_frames);
+    hal_uart_puts(msgstr);
+}
+
+// Reply to a macro definition with its length and the pool space left
+static void macro_reply(const char *cmd, uint8_t result)
+{
+    char msgstr[32];
+
+    if (result == MACRO_OK)
+        sprintf(msgstr, "+%s %04X %04X\r\n", cmd, (unsigned int)macros[macro_last].len,
+                (unsigned int)(MACRO_POOL - macro_used));
+    else
+        sprintf(msgstr, "+%s %s\r\n", cmd, result == MACRO_FULL ? "FULL" : "ERR");
+    hal_uart_puts(msgstr);
+}
+
+// Define a macro: MDEF <name> <items>
+static void cmd_mdef(char *arg)
+{
+    char *src = strchr(arg, ' ');
+    if (src)
+        *src++ = 0;
+    else
+        src = arg + strlen(arg);
+    macro_reply("MDEF", macro_define(arg, src));
+}
+
+// Add to the macro defined last
+static void cmd_madd(char *arg)
+{
+    macro_reply("MADD", macro_append(arg));
+}
+
+// Delete a macro
+static void cmd_mdel(char *arg)
+{
+    if (macro_delete(arg))
+        hal_uart_puts("+MDEL 1\r\n");
+    else
+        hal_uart_puts("+MDEL ERR\r\n");
+}
+
+// List the macros, then the number of them and the pool space left
+static void cmd_ml(char *arg)
+{
+    (void)arg;
+    char msgstr[32];
+    unsigned int count = 0;
+
+    for (int i = 0; i < MACRO_COUNT; i++)
+    {
+        if (macros[i].name[0] == 0)
+            continue;
+        sprintf(msgstr, "+M %s %04X %u\r\n", macros[i].name, (unsigned int)macros[i].len, macros[i].open);
+        hal_uart_puts(msgstr);
+        count++;
+    }
+    sprintf(msgstr, "+ML %02X %04X\r\n", count, (unsigned int)(MACRO_POOL - macro_used));
+    hal_uart_puts(msgstr);
+}
+
+// Run a macro, or stop it with no name
+static void cmd_mrun(char *arg)
+{
+    if (arg[0] == 0)
+    {
+        macro_stop(cmd_player);
+        hal_uart_puts("+MRUN 0\r\n");
+    }
+    else if (macro_run(cmd_player, arg))
+        hal_uart_puts("+MRUN 1\r\n");
+    else
+        hal_uart_puts("+MRUN ERR\r\n");
+}
+
+// Find the best VSYNC delay automatically
+static void cmd_vsa(char *arg)
+{
+    (void)arg;
+#ifdef SWICC_LOW_LATENCY_HID
+    // The host polls every 1 ms, so there is never a gap to find
+    hal_uart_puts("+VSA OFF\r\n");
+#else
+    if (!vpll_scan_start())
+        hal_uart_puts("+VSA ERR\r\n");
+#endif
+}
+
+// Get the estimated VSYNC period, in 1/16 us
+static void cmd_gvp(char *arg)
+{
+    (void)arg;
+    char msgstr[20];
+    sprintf(msgstr, "+GVP %06X\r\n", (unsigned int)vpll_period);
+    hal_uart_puts(msgstr);
+}
+
+// Get the last VSYNC phase error and the average error (jitter), in us
+static void cmd_gve(char *arg)
+{
+    (void)arg;
+    char msgstr[20];
+    sprintf(msgstr, "+GVE %04X %04X\r\n", (uint16_t)vpll_error_us,
+            (unsigned int)(vpll_jitter >> VPLL_FRAC));
+    hal_uart_puts(msgstr);
+}
+
+// Get the VSYNC lock state and the missing and rejected edge counts
+static void cmd_gvl(char *arg)
+{
+    (void)arg;
+    char msgstr[24];
+    sprintf(msgstr, "+GVL %u %04X %04X\r\n", vpll_locked,
+            (unsigned int)vpll_flywheel_count, (unsigned int)vpll_reject_count);
+    hal_uart_puts(msgstr);
+}
+
+// Start (1) or stop (0) the timing trace
+static void cmd_trc(char *arg)
+{
+    if (arg[0] == '1')
+        trace_start();
+    else
+        trace_stop();
+}
+
+// Dump the timing trace
+static void cmd_trd(char *arg)
+{
+    (void)arg;
+    trace_dump_start(false);
+}
+
+// Get HID latency statistics, and start a new measurement
+static void cmd_glat(char *arg)
+{
+    (void)arg;
+    send_latency();
+}
+
+// Change the baud rate, or confirm a change
+static void cmd_baud(char *arg)
+{
+    if (strncmp(arg, "OK", 2) == 0)
+    {
+        baud_pending = false;
+        hal_uart_puts("+BAUD OK\r\n");
+    }
+    else if (arg[0] >= '0' && arg[0] <= '9')
+    {
+        request_baud(strtoul(arg, NULL, 10));
+    }
+    else
+    {
+        char msgstr[20];
+        sprintf(msgstr, "+BAUD %u\r\n", baud_rate);
+        hal_uart_puts(msgstr);
+    }
+}
+
+// Switch to binary framed protocol
+static void cmd_bin(char *arg)
+{
+    if (arg[0] == '1')
+    {
+        hal_uart_puts("+BIN 1\r\n");
+        swf_decoder_reset(&frame_dec);
+        binary_mode = true;
+    }
+}
+
+// Choose the player that later commands act on, or report it
+static void cmd_p(char *arg)
+{
+    char msgstr[12];
+
+    if (arg[0] >= '0' && arg[0] <= '9')
+    {
+        unsigned int n = arg[0] - '0';
+        if (n >= SWICC_PLAYERS || (arg[1] >= '0' && arg[1] <= '9'))
+        {
+            hal_uart_puts("+P ERR\r\n");
+            return;
+        }
+        cmd_player = &players[n];
+    }
+    sprintf(msgstr, "+P %u\r\n", player_index(cmd_player));
+    hal_uart_puts(msgstr);
+}
+
+// Schedule a controller state for an absolute frame: AT <frame> <state>
+static void cmd_at(char *arg)
+{
+    uint8_t frame[4];
+    USB_ControllerReport_Input_t con;
+    char msgstr[24];
+
+    if (hex_decode(arg, frame, 4) != 4 || arg[8] != ' ' || parse_con_state(arg + 9, &con) < 0)
+    {
+        hal_uart_puts("+AT ERR\r\n");
+        return;
+    }
+
+    switch (sched_add(get_be32(frame), cmd_player, &con))
+    {
+    case SCHED_LATE:
+        hal_uart_puts("+AT LATE\r\n");
+        break;
+    case SCHED_FULL:
+        hal_uart_puts("+AT FULL\r\n");
+        break;
+    default:
+        sprintf(msgstr, "+AT %02X\r\n", sched_pending());
+        hal_uart_puts(msgstr);
+        break;
+    }
+}
+
+// Drop every scheduled controller state
+static void cmd_atc(char *arg)
+{
+    (void)arg;
+    sched_clear();
+    hal_uart_puts("+ATC\r\n");
+}
+
+// Enable / disable LED
+static void cmd_led(char *arg)
+{
+    if (arg[0] == '1')
+    {
+        led_on = true;
+    }
+    else
+    {
+        led_on = false;
+    }
+}
+
+typedef void (*cmd_handler_t)(char *arg);
+
+// Text commands, kept sorted by name so they can be binary searched
+static const struct {
+    const char *name;
+    cmd_handler_t handler;
+} commands[] = {
+    { "AT",    cmd_at },
+    { "ATC",   cmd_atc },
+    { "BAUD",  cmd_baud },
+    { "BIN",   cmd_bin },
+    { "GCS",   cmd_gcs },
+    { "GFC",   cmd_gfc },
+    { "GLAT",  cmd_glat },
+    { "GMV",   cmd_gmv },
+    { "GOV",   cmd_gov },
+    { "GQF",   cmd_gqf },
+    { "GQR",   cmd_gqr },
+    { "GR",    cmd_gr },
+    { "GRB",   cmd_grb },
+    { "GRF",   cmd_grf },
+    { "GRR",   cmd_grr },
+    { "GVE",   cmd_gve },
+    { "GVL",   cmd_gvl },
+    { "GVP",   cmd_gvp },
+    { "ID",    cmd_id },
+    { "IMM",   cmd_imm },
+    { "LED",   cmd_led },
+    { "MADD",  cmd_madd },
+    { "MDEF",  cmd_mdef },
+    { "MDEL",  cmd_mdel },
+    { "ML",    cmd_ml },
+    { "MRUN",  cmd_mrun },
+    { "MVB",   cmd_mvb },
+    { "MVC",   cmd_mvc },
+    { "MVP",   cmd_mvp },
+    { "MVW",   cmd_mvw },
+    { "P",     cmd_p },
+    { "Q",     cmd_q },
+    { "QB",    cmd_qb },
+    { "QL",    cmd_ql },
+    { "QWM",   cmd_qwm },
+    { "REC",   cmd_rec },
+    { "SLAG",  cmd_slag },
+    { "SLAGU", cmd_slagu },
+    { "TRC",   cmd_trc },
+    { "TRD",   cmd_trd },
+    { "VER",   cmd_ver },
+    { "VSA",   cmd_vsa },
+    { "VSD",   cmd_vsd },
+    { "VSYNC", cmd_vsync },
+};
+
+/* Name of the text command at a position in the dispatch table, or NULL past
+ *  the end.  For host tools that need the command list.
+ */
+const char *command_name(unsigned int index)
+{
+    if (index >= sizeof(commands) / sizeof(commands[0]))
+        return NULL;
+    return commands[index].name;
+}
+
+// Find the handler for a command name that is len characters long
+static cmd_handler_t find_command(const char *name, size_t len)
+{
+    int low = 0;
+    int high = (int)(sizeof(commands) / sizeof(commands[0])) - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        const char *entry = commands[mid].name;
+        int cmp = strncmp(name, entry, len);
+        if (cmp == 0 && entry[len] != '\0')
+            cmp = -1; // name is a prefix of the entry, so sorts before it
+        if (cmp == 0)
+            return commands[mid].handler;
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+/* Execute one complete text command (without the leading command character).
+ */
+void process_command(char *cmd_str)
+{
+    // The command name runs up to the first space, and the space is required
+    char *space = strchr(cmd_str, ' ');
+    if (space == NULL)
+        return;
+
+    cmd_handler_t handler = find_command(cmd_str, space - cmd_str);
+    if (handler != NULL)
+        handler(space + 1);
+}
+
+/* Switch to a new baud rate, pending confirmation from the host.
+ *  The reply goes out at the old rate.  The host must then send "+BAUD OK" at
+ *  the new rate within BAUD_CONFIRM_MS, or the link falls back to BAUD_RATE.
+ */
+void request_baud(unsigned int rate)
+{
+    char msgstr[20];
+    bool valid = false;
+
+    for (unsigned int i = 0; i < sizeof(baud_rates) / sizeof(baud_rates[0]); i++)
+    {
+        if (baud_rates[i] == rate)
+            valid = true;
+    }
+    if (!valid)
+    {
+        // Unsupported; report the rate still in use
+        sprintf(msgstr, "+BAUD %u\r\n", baud_rate);
+        hal_uart_puts(msgstr);
+        return;
+    }
+
+    sprintf(msgstr, "+BAUD %u\r\n", rate);
+    hal_uart_puts(msgstr);
+    hal_set_baud(rate);
+
+    baud_rate = rate;
+    baud_pending = (rate != BAUD_RATE);
+    baud_deadline_us = hal_time_us() + (uint64_t)BAUD_CONFIRM_MS * 1000;
+}
+
+/* Fall back to the default baud rate if a change was never confirmed.
+ */
+void baud_task()
+{
+    if (baud_pending && (hal_time_us() > baud_deadline_us))
+    {
+        baud_pending = false;
+        hal_set_baud(BAUD_RATE);
+        baud_rate = BAUD_RATE;
+    }
+}
+
+/* Report and reset the HID latency statistics.
+ *  Sends the average and maximum microseconds from a frame update to its
+ *  report being queued, then to the host collecting it.
+ */
+void send_latency()
+{
+    char msgstr[48];
+
+    uint32_t irq_state = hal_irq_save();
+    lat_stat_t sub = lat_submit, comp = lat_complete;
+    memset(&lat_submit, 0, sizeof(lat_stat_t));
+    memset(&lat_complete, 0, sizeof(lat_stat_t));
+    hal_irq_restore(irq_state);
+
+    sprintf(msgstr, "+GLAT %04X %04X %04X %04X\r\n",
+            sub.count ? (unsigned int)(sub.sum / sub.count) : 0, (unsigned int)sub.max,
+            comp.count ? (unsigned int)(comp.sum / comp.count) : 0, (unsigned int)comp.max);
+    hal_uart_puts(msgstr);
+}
+
+/* Add one latency sample.
+ */
+void lat_add(lat_stat_t *stat, uint32_t us)
+{
+    stat->count++;
+    stat->sum += us;
+    if (us > stat->max)
+        stat->max = us;
+}
+
+/* Respond with an integer encoded in hex, starting with + and a header, ending with newline.
+ */
+void uart_resp_int(const char *header, unsigned int msg)
+{
+    char msgstr[24];
+
+    sent_count++;
+
+    snprintf(msgstr, sizeof(msgstr), "+%s %04X\r\n", header, msg);
+    hal_uart_puts(msgstr);
+}
+
+/* Send a response with a value too large for four hex digits.
+ */
+void uart_resp_long(const char *header, uint32_t msg)
+{
+    char msgstr[24];
+
+    sent_count++;
+
+    snprintf(msgstr, sizeof(msgstr), "+%s %08X\r\n", header, (unsigned int)msg);
+    hal_uart_puts(msgstr);
+}
+
+/* Send a binary frame.
+ */
+void send_frame(uint8_t opcode, const uint8_t *payload, size_t len)
+{
+    uint8_t enc[SWF_MAX_ENCODED];
+    size_t enc_len = swf_encode(opcode, payload, len, enc);
+    hal_uart_write(enc, enc_len);
+}
+
+/* Send a binary frame carrying a single 16-bit big-endian value.
+ */
+void send_frame_int(uint8_t opcode, uint16_t msg)
+{
+    uint8_t payload[2] = {msg >> 8, msg & 0xFF};
+    send_frame(opcode, payload, sizeof(payload));
+}
+
+/* Process one validated binary frame.
+ *  frame[0] is the opcode, followed by len-1 bytes of payload.
+ */
+void process_frame(const uint8_t *frame, int len)
+{
+    player_t *p = cmd_player;
+    USB_ControllerReport_Input_t con;
+    const uint8_t *payload = frame + 1;
+    int payload_len = len - 1;
+
+    switch (frame[0])
+    {
+    case BOP_QUEUE:
+        if (payload_len != SWF_CON_LEN)
+            break;
+        unpack_con(payload, &con);
+        if (!queue_con(p, &con))
+            send_frame_int(BOP_QUEUE | BOP_REPLY, p->queue_rejected);
+        p->action_mode = A_PLAY;
+        return;
+
+    case BOP_QUEUE_LAG:
+        if (payload_len != SWF_CON_LEN)
+            break;
+        unpack_con(payload, &con);
+        lag_con(p, &con);
+        p->action_mode = A_LAG;
+        return;
+
+    case BOP_QUEUE_BATCH:
+        if (payload_len == 0 || (payload_len % SWF_CON_LEN) != 0)
+            break;
+        {
+            USB_ControllerReport_Input_t cons[SWF_MAX_PAYLOAD / SWF_CON_LEN];
+            int count = payload_len / SWF_CON_LEN;
+            for (int i = 0; i < count; i++)
+            {
+                unpack_con(payload + i * SWF_CON_LEN, &cons[i]);
+            }
+            int accepted = queue_con_batch(p, cons, count);
+            p->action_mode = A_PLAY;
+            uint16_t fill = get_queue_fill(p);
+            uint8_t resp[4] = {accepted >> 8, accepted & 0xFF, fill >> 8, fill & 0xFF};
+            send_frame(BOP_QUEUE_BATCH | BOP_REPLY, resp, sizeof(resp));
+        }
+        return;
+
+    case BOP_IMM:
+        if (payload_len != SWF_CON_LEN)
+            break;
+        unpack_con(payload, &con);
+        set_con_state(p, &con);
+        // Reset queue
+        queue_clear(p);
+        return;
+
+    case BOP_GQF:
+        send_frame_int(BOP_GQF | BOP_REPLY, get_queue_fill(p));
+        return;
+
+    case BOP_REC_DUMP:
+        if (payload_len == 0)
+        {
+            rec_dump_start(p, 0, 0xFFFFFFFF);
+            return;
+        }
+        if (payload_len != 8)
+            break;
+        rec_dump_start(p, get_be32(payload), get_be32(payload + 4));
+        return;
+
+    case BOP_CREDIT:
+        if (payload_len != 2 || !dump_active)
+            break;
+        dump_credits += ((uint16_t)payload[0] << 8) | payload[1];
+        return;
+
+    case BOP_MOVIE_DATA:
+    {
+        // The offset guards against a lost or repeated chunk
+        if (payload_len < 4 || get_be32(payload) != movie_written)
+            break;
+        int written = movie_write(payload + 4, payload_len - 4);
+        if (written < 0)
+            break;
+        uint8_t resp[4];
+        put_be32(resp, written);
+        send_frame(BOP_MOVIE_DATA | BOP_REPLY, resp, sizeof(resp));
+        return;
+    }
+
+    case BOP_QWM:
+        if (payload_len != 4)
+            break;
+        set_queue_marks(p, ((uint16_t)payload[0] << 8) | payload[1], ((uint16_t)payload[2] << 8) | payload[3]);
+        send_frame(BOP_QWM | BOP_REPLY, payload, 4);
+        return;
+
+    case BOP_PLAYER:
+        if (payload_len != 1 || payload[0] >= SWICC_PLAYERS)
+            break;
+        cmd_player = &players[payload[0]];
+        send_frame(BOP_PLAYER | BOP_REPLY, payload, 1);
+        return;
+
+    case BOP_GFC:
+    {
+        if (payload_len != 0)
+            break;
+        uint8_t resp[4];
+        put_be32(resp, frame_seq);
+        send_frame(BOP_GFC | BOP_REPLY, resp, sizeof(resp));
+        return;
+    }
+
+    case BOP_AT:
+    {
+        if (payload_len != 4 + SWF_CON_LEN)
+            break;
+        unpack_con(payload + 4, &con);
+        uint8_t resp[2];
+        resp[0] = sched_add(get_be32(payload), p, &con);
+        resp[1] = sched_pending();
+        send_frame(BOP_AT | BOP_REPLY, resp, sizeof(resp));
+        return;
+    }
+
+    case BOP_MACRO:
+    {
+        // The payload is the name; none stops the macro
+        char name[MACRO_NAME_LEN + 1];
+        uint8_t resp = 0;
+        if (payload_len > MACRO_NAME_LEN)
+            break;
+        if (payload_len == 0)
+            macro_stop(p);
+        else
+        {
+            memcpy(name, payload, payload_len);
+            name[payload_len] = 0;
+            if (!macro_run(p, name))
+                break;
+            resp = 1;
+        }
+        send_frame(BOP_MACRO | BOP_REPLY, &resp, 1);
+        return;
+    }
+
+    case BOP_TRACE:
+        if (payload_len != 0)
+            break;
+        trace_dump_start(true);
+        return;
+
+    case BOP_ASCII:
+        send_frame(BOP_ASCII | BOP_REPLY, NULL, 0);
+        binary_mode = false;
+        dump_active = false;
+        return;
+
+    default:
+        break;
+    }
+
+    // Unknown opcode or wrong payload size
+    frame_err_count++;
+    send_frame_int(BOP_NAK, frame_err_count);
+}
+
+/* Send one line of the recording: a controller state and a repeat count.
+ */
+void send_recording_entry(const uint8_t *state, uint8_t count) {
+    char msgstr[32];
+
+    // Header, controller state, RLE count, termination
+    sprintf(msgstr, "+R %02X%02X%02X%02X%02X%02X%02Xx%02X\r\n",
+            state[0], state[1], state[2], state[3], state[4], state[5], state[6],
+            count);
+    hal_uart_puts(msgstr);
+
+}
+
+/* Send up to 30 lines of the recording from the stream position.
+ *  Runs longer than REC_LINE_MAX frames are split over several lines, so the
+ *  text format is unchanged by the compact storage.  The run in progress
+ *  comes last and is split the same way, counting towards the 30 lines.
+ */
+void send_recording(player_t *p)
+{
+    uint8_t state[SWF_CON_LEN];
+    uint32_t run;
+
+    for (uint8_t i = 0; i < 30; i++)
+    {
+        // The frame interrupt may be recording into the ring; hold it off
+        // while taking the next line, but not while sending it
+        uint32_t irq_state = hal_irq_save();
+        if (p->stream_left == 0)
+        {
+            if (p->stream_pos != p->rec_head)
+            {
+                p->stream_pos = (p->stream_pos + rec_read(p, p->stream_pos, p->stream_state, &p->stream_left)) % REC_BUFF_BYTES;
+            }
+            else if (!p->stream_open && p->rec_run > 0)
+            {
+                pack_con(&p->rec_cur, p->stream_state);
+                p->stream_left = p->rec_run;
+                p->stream_open = true;
+            }
+            else
+            {
+                hal_irq_restore(irq_state);
+                break;
+            }
+        }
+        run = p->stream_left < REC_LINE_MAX ? p->stream_left : REC_LINE_MAX;
+        p->stream_left -= run;
+        memcpy(state, p->stream_state, SWF_CON_LEN);
+        hal_irq_restore(irq_state);
+
+        send_recording_entry(state, run);
+    }
+}
+
+//--------------------------------------------------------------------
+// Recording code
+//--------------------------------------------------------------------
+
+/* Start a new recording from the current controller state.
+ *  Must be called with interrupts held off.
+ */
+void rec_start(player_t *p)
+{
+    p->recording = false;
+    p->rec_head = 0;
+    p->rec_tail = 0;
+    p->rec_used = 0;
+    p->recording_wrap = false;
+    pack_con(&p->current_con, p->rec_base);
+    memcpy(p->rec_last, p->rec_base, SWF_CON_LEN);
+    memcpy(&p->rec_cur, &p->current_con, sizeof(USB_ControllerReport_Input_t));
+    p->rec_run = 1;
+    p->recording = true;
+}
+
+/* Encode the run in progress into the recording ring.
+ *  The oldest records are dropped if there is not enough room.  Must be
+ *  called with interrupts held off (the frame interrupt already is).
+ */
+void rec_close_run(player_t *p)
+{
+    uint8_t state[SWF_CON_LEN];
+    uint8_t record[REC_MAX_RECORD];
+
+    pack_con(&p->rec_cur, state);
+    size_t len = rec_encode(p->rec_last, state, p->rec_run, record);
+    memcpy(p->rec_last, state, SWF_CON_LEN);
+
+    // Always leave at least one byte free so head == tail means empty
+    while ((REC_BUFF_BYTES - p->rec_used) <= len)
+    {
+        rec_drop_oldest(p);
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        p->rec_buff[p->rec_head] = record[i];
+        p->rec_head = (p->rec_head + 1) % REC_BUFF_BYTES;
+    }
+    p->rec_used += len;
+}
+
+/* Discard the oldest record, folding its state into rec_base.
+ *  A GR readout waiting at that record moves on with the tail.
+ */
+void rec_drop_oldest(player_t *p)
+{
+    uint32_t run;
+    unsigned int old_tail = p->rec_tail;
+    unsigned int len = rec_read(p, p->rec_tail, p->rec_base, &run);
+
+    p->rec_tail = (p->rec_tail + len) % REC_BUFF_BYTES;
+    if (p->stream_pos == old_tail)
+    {
+        p->stream_pos = p->rec_tail;
+        memcpy(p->stream_state, p->rec_base, SWF_CON_LEN);
+    }
+    p->rec_used -= len;
+    p->recording_wrap = true;
+    // When streaming live, the ring is only a backlog; this run never went out
+    if (p->rec_live)
+        p->rec_live_lost++;
+}
+
+/* Send one player's finished runs while live streaming.
+ */
+static void rec_live_player(player_t *p)
+{
+    char msgstr[32];
+    uint8_t state[SWF_CON_LEN];
+    uint32_t run;
+
+    if (!p->rec_live)
+        return;
+
+    while (p->rec_used > 0)
+    {
+        // The frame interrupt may drop the oldest run, so hold it off
+        uint32_t irq_state = hal_irq_save();
+
+        memcpy(state, p->rec_base, SWF_CON_LEN);
+        unsigned int len = rec_read(p, p->rec_tail, state, &run);
+        sprintf(msgstr, "+R%s %02X%02X%02X%02X%02X%02X%02Xx%02X\r\n", player_suffix(p),
+                state[0], state[1], state[2], state[3], state[4], state[5], state[6],
+                (unsigned int)run);
+        bool sent = hal_uart_try_write((const uint8_t *)msgstr, strlen(msgstr));
+        if (sent)
+        {
+            memcpy(p->rec_base, state, SWF_CON_LEN);
+            p->rec_tail = (p->rec_tail + len) % REC_BUFF_BYTES;
+            p->rec_used -= len;
+        }
+
+        hal_irq_restore(irq_state);
+        if (!sent)
+            break;
+    }
+
+    // Tell the host if the backlog ever overflowed
+    if (p->rec_live_lost != p->rec_lost_reported)
+    {
+        sprintf(msgstr, "+RLOST%s %04X\r\n", player_suffix(p), p->rec_live_lost);
+        if (hal_uart_try_write((const uint8_t *)msgstr, strlen(msgstr)))
+            p->rec_lost_reported = p->rec_live_lost;
+    }
+}
+
+/* Send finished runs to the host while live streaming.
+ *  Called from the main loop.  Each run is removed from the ring once it is
+ *  queued for output, so the ring only holds what the link has not yet taken.
+ *  Lines for players other than 0 start with "+R" and the player index.
+ */
+void rec_live_task()
+{
+    for (int n = 0; n < SWICC_PLAYERS; n++)
+    {
+        rec_live_player(&players[n]);
+    }
+}
+
+/* Decode the record at a position in the recording ring.
+ *  state is updated from the previous record's state.  Returns the record
+ *  length in bytes.
+ */
+unsigned int rec_read(player_t *p, unsigned int pos, uint8_t *state, uint32_t *run)
+{
+    uint8_t record[REC_MAX_RECORD];
+
+    for (unsigned int i = 0; i < REC_MAX_RECORD; i++)
+    {
+        record[i] = p->rec_buff[(pos + i) % REC_BUFF_BYTES];
+    }
+    int len = rec_decode(record, REC_MAX_RECORD, state, run);
+
+    // Only records written by rec_close_run are in the ring, so this
+    // cannot fail; guard against looping forever anyway.
+    return len > 0 ? (unsigned int)len : 1;
+}
+
+/* Set a new amount of delay from VSYNC to controller data change.
+ */
+int set_frame_delay(const char *cstr)
+{
+    uint8_t delay[2];
+
+    if (hex_decode(cstr, delay, 2) < 2)
+        return -1;
+    frame_delay_us = (delay[0] << 8) | delay[1];
+    return 0;
+}
+
+/* Add a new controller state to the buffer.
+ *  Incoming data is a hex-encoded string.  If the queue is full, the state is
+ *  refused and the host is told how many states have been refused so far.
+ */
+int add_to_queue(player_t *p, const char *cstr)
+{
+    USB_ControllerReport_Input_t con;
+
+    if (parse_con_state(cstr, &con) < 0)
+        return -1;
+
+    if (!queue_con(p, &con))
+    {
+        uart_resp_int("QFULL", p->queue_rejected);
+        return -1;
+    }
+
+    return get_queue_fill(p);
+}
+
+/* Add a decoded controller state to the buffer.
+ *  Returns false if the queue was full.
+ */
+bool queue_con(player_t *p, const USB_ControllerReport_Input_t *con)
+{
+    return queue_con_batch(p, con, 1) == 1;
+}
+
+/* Add a batch of hex-encoded controller states to the buffer.
+ *  Each state must be the full 14 hex characters, with no separators.
+ *  Replies once with the number of states accepted and the resulting fill.
+ */
+int queue_batch(player_t *p, const char *cstr)
+{
+    USB_ControllerReport_Input_t cons[QB_MAX_FRAMES];
+    int count = 0;
+    char msgstr[20];
+
+    // Decode everything first so the queue is only touched once
+    while (count < QB_MAX_FRAMES && strlen(cstr) >= 14)
+    {
+        if (parse_con_state(cstr, &cons[count]) < 0)
+            break;
+        count++;
+        cstr += 14;
+    }
+
+    int accepted = queue_con_batch(p, cons, count);
+    // Adding a batch means the user wants to play the queue
+    p->action_mode = A_PLAY;
+
+    sprintf(msgstr, "+QB %04X %04X\r\n", accepted, get_queue_fill(p));
+    hal_uart_puts(msgstr);
+
+    return accepted;
+}
+
+/* Add several decoded controller states to the buffer in one step.
+ *  The entries are written first and the head is published once, so playback
+ *  never sees a partial batch.  States that do not fit are refused rather than
+ *  overwriting unplayed entries.  Returns the number of states accepted.
+ */
+int queue_con_batch(player_t *p, const USB_ControllerReport_Input_t *cons, int count)
+{
+    unsigned int head = p->queue_head; // only written here
+    unsigned int tail = __atomic_load_n(&p->queue_tail, __ATOMIC_ACQUIRE);
+
+    int space = (CON_BUFF_LEN - 1) - ((head - tail) & CON_BUFF_MASK);
+    int accepted = count < space ? count : space;
+    for (int i = 0; i < accepted; i++)
+    {
+        head = (head + 1) & CON_BUFF_MASK;
+        memcpy(&(p->con_data_buff[head]), &cons[i], sizeof(USB_ControllerReport_Input_t));
+    }
+    __atomic_store_n(&p->queue_head, head, __ATOMIC_RELEASE);
+
+    p->queue_rejected += count - accepted;
+
+    return accepted;
+}
+
+/* Discard everything not yet played.
+ *  Only the head moves, so this is safe against a concurrent frame update;
+ *  callers leave the play mode first so the tail is not advancing.  For the
+ *  command parser only; the frame update uses queue_drain.
+ */
+void queue_clear(player_t *p)
+{
+    __atomic_store_n(&p->queue_head, __atomic_load_n(&p->queue_tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+/* Discard everything not yet played, from the frame update.
+ *  Only the tail moves, so the parser stays the single writer of the head.
+ *  States it adds after this are kept.
+ */
+void queue_drain(player_t *p)
+{
+    __atomic_store_n(&p->queue_tail, __atomic_load_n(&p->queue_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+/* Set the newest state of the lagged queue.
+ *  Incoming data is a hex-encoded string.
+ */
+int add_to_lag(player_t *p, const char *cstr)
+{
+    USB_ControllerReport_Input_t con;
+
+    if (parse_con_state(cstr, &con) < 0)
+        return -1;
+
+    lag_con(p, &con);
+
+    return 0;
+}
+
+/* Add a decoded state to the lagged queue, stamped with its arrival time.
+ *  If the delay line is full, the oldest state is let out early rather than
+ *  losing the newest.
+ */
+void lag_con(player_t *p, const USB_ControllerReport_Input_t *con)
+{
+    uint32_t irq_state = hal_irq_save();
+
+    if (p->lag_head - p->lag_tail == LAG_BUFF_LEN)
+    {
+        memcpy(&p->current_con, &p->lag_buff[p->lag_tail & LAG_BUFF_MASK].con, sizeof(USB_ControllerReport_Input_t));
+        p->lag_tail++;
+        con_publish(p);
+    }
+
+    lag_event_t *e = &p->lag_buff[p->lag_head & LAG_BUFF_MASK];
+    e->stamp_us = (uint32_t)hal_time_us();
+    memcpy(&e->con, con, sizeof(USB_ControllerReport_Input_t));
+    p->lag_head++;
+
+    hal_irq_restore(irq_state);
+}
+
+/* Move every lagged state that has waited lag_us into current_con.
+ *  Returns true if any was.  Must be called with interrupts held off.
+ */
+static bool lag_drain(player_t *p)
+{
+    uint32_t now = (uint32_t)hal_time_us();
+    bool released = false;
+
+    // Signed, so a state stamped just after now reads is not let out early
+    while (p->lag_tail != p->lag_head &&
+        (int32_t)(now - p->lag_buff[p->lag_tail & LAG_BUFF_MASK].stamp_us) >= (int32_t)p->lag_us)
+    {
+        memcpy(&p->current_con, &p->lag_buff[p->lag_tail & LAG_BUFF_MASK].con, sizeof(USB_ControllerReport_Input_t));
+        p->lag_tail++;
+        released = true;
+    }
+    return released;
+}
+
+/* Let out lagged states that are due, between frames.
+ *  Called as often as possible so each state is released close to exactly
+ *  lag_us after it arrived rather than on the next frame boundary.
+ */
+void lag_release(player_t *p)
+{
+    // Cheap check first; nothing is waiting most of the time
+    if (p->action_mode != A_LAG || __atomic_load_n(&p->lag_head, __ATOMIC_RELAXED) == p->lag_tail)
+        return;
+
+    uint32_t irq_state = hal_irq_save();
+    if (lag_drain(p))
+        con_publish(p);
+    hal_irq_restore(irq_state);
+}
+
+/* Set the lag, in microseconds.
+ *  Lowering it lets the states that are now due out at the next check.
+ */
+void set_lag_us(player_t *p, uint32_t us)
+{
+    if (us > LAG_MAX_US)
+        us = LAG_MAX_US;
+
+    uint32_t irq_state = hal_irq_save();
+    p->lag_us = us;
+    hal_irq_restore(irq_state);
+}
+
+/* Decode a hex-encoded controller state.
+ *  The first six characters (buttons and HAT) are mandatory; the sticks are
+ *  set to neutral if the remaining eight are not all present.  Hex digits may
+ *  be upper or lower case.
+ */
+int parse_con_state(const char *cstr, USB_ControllerReport_Input_t *con)
+{
+    uint8_t state[SWF_CON_LEN];
+    size_t len = hex_decode(cstr, state, SWF_CON_LEN);
+
+    // error on any non-hex characters in mandatory bytes
+    if (len < 3)
+        return -1;
+
+    con->Button = (state[0] << 8) | state[1];
+    con->HAT = state[2];
+    con->VendorSpec = 0;
+
+    if (len == SWF_CON_LEN)
+    {
+        con->LX = state[3];
+        con->LY = state[4];
+        con->RX = state[5];
+        con->RY = state[6];
+    }
+    else
+    {
+        con->LX = 0x80;
+        con->LY = 0x80;
+        con->RX = 0x80;
+        con->RY = 0x80;
+    }
+
+    return 0;
+}
+
+/* Encode a controller state into its 7-byte wire format.
+ */
+void pack_con(const USB_ControllerReport_Input_t *con, uint8_t *data)
+{
+    data[0] = con->Button >> 8;
+    data[1] = con->Button & 0xFF;
+    data[2] = con->HAT;
+    data[3] = con->LX;
+    data[4] = con->LY;
+    data[5] = con->RX;
+    data[6] = con->RY;
+}
+
+/* Decode a controller state from its 7-byte wire format.
+ */
+void unpack_con(const uint8_t *data, USB_ControllerReport_Input_t *con)
+{
+    con->Button = ((uint16_t)data[0] << 8) | data[1];
+    con->HAT = data[2];
+    con->LX = data[3];
+    con->LY = data[4];
+    con->RX = data[5];
+    con->RY = data[6];
+    con->VendorSpec = 0;
+}
+
+/* Set the queue watermarks.  Out-of-range values disable a mark.
+ */
+void set_queue_marks(player_t *p, int low, int high)
+{
+    uint32_t irq_state = hal_irq_save();
+    p->queue_low_mark = (low > 0 && low < CON_BUFF_LEN) ? low : 0;
+    p->queue_high_mark = (high > 0 && high < CON_BUFF_LEN) ? high : 0;
+    p->queue_low_armed = true;
+    p->queue_high_armed = true;
+    hal_irq_restore(irq_state);
+}
+
+/* Tell the host if the queue fill has crossed a watermark.
+ *  Called from the frame update, so it never waits for the serial link; a
+ *  notice that doesn't fit is tried again next frame.
+ */
+void queue_mark_check(player_t *p)
+{
+    unsigned int fill = get_queue_fill(p);
+    uint8_t kind;
+
+    if (p->queue_low_mark && p->queue_low_armed && fill <= p->queue_low_mark)
+        kind = 0;
+    else if (p->queue_high_mark && p->queue_high_armed && fill >= p->queue_high_mark)
+        kind = 1;
+    else
+    {
+        // Re-arm once the fill is back on the other side
+        if (fill > p->queue_low_mark)
+            p->queue_low_armed = true;
+        if (fill < p->queue_high_mark)
+            p->queue_high_armed = true;
+        return;
+    }
+
+    uint8_t msg[SWF_MAX_ENCODED];
+    size_t len;
+    if (binary_mode)
+    {
+        // Players other than 0 add their index
+        uint8_t payload[4] = {kind, fill >> 8, fill & 0xFF, player_index(p)};
+        len = swf_encode(BOP_QMARK | BOP_REPLY, payload, p == players ? 3 : 4, msg);
+    }
+    else
+        len = sprintf((char *)msg, kind ? "+QHIGH%s %04X\r\n" : "+QLOW%s %04X\r\n", player_suffix(p), fill);
+
+    if (hal_uart_try_write(msg, len))
+    {
+        if (kind)
+            p->queue_high_armed = false;
+        else
+            p->queue_low_armed = false;
+    }
+}
+
+/* Returns the amount of space currently used in the playback buffer.
+ */
+unsigned int get_queue_fill(player_t *p)
+{
+    unsigned int tail = __atomic_load_n(&p->queue_tail, __ATOMIC_ACQUIRE);
+    unsigned int head = __atomic_load_n(&p->queue_head, __ATOMIC_ACQUIRE);
+
+    // Masking accounts for the fact that the buffer wraps around.
+    return (head - tail) & CON_BUFF_MASK;
+}
+
+/* Set a new forced controller state (aka an immediate state).
+ *  Data is a hex-encoded string.
+ */
+int force_con_state(player_t *p, const char *cstr)
+{
+    USB_ControllerReport_Input_t con;
+
+    if (parse_con_state(cstr, &con) < 0)
+        return -1;
+
+    set_con_state(p, &con);
+
+    return get_queue_fill(p);
+}
+
+/* Set a new forced controller state from a decoded controller state.
+ */
+void set_con_state(player_t *p, const USB_ControllerReport_Input_t *con)
+{
+    // Keep the frame interrupt out until the new state is published
+    uint32_t irq_state = hal_irq_save();
+
+    // Assume that writing an immediate means the user wants to enter a real-time mode
+    p->action_mode = A_RT;
+
+    // Write the data to the controller state variable.
+    memcpy(&p->current_con, con, sizeof(USB_ControllerReport_Input_t));
+    con_publish(p);
+
+    hal_irq_restore(irq_state);
+}
+
+/* Publish a controller state to the USB side.
+ *  Called from the frame interrupt, or elsewhere with interrupts held off, so
+ *  there is only ever one writer at a time.
+ */
+void con_publish(player_t *p)
+{
+    uint32_t seq = p->con_pub_seq;
+
+    __atomic_store_n(&p->con_pub_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&p->con_pub, &p->current_con, sizeof(USB_ControllerReport_Input_t));
+    __atomic_store_n(&p->con_pub_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Read the latest published controller state.
+ *  Retries if a new state was published part way through the copy.
+ */
+void con_read(player_t *p, USB_ControllerReport_Input_t *con)
+{
+    uint32_t before, after;
+
+    do
+    {
+        before = __atomic_load_n(&p->con_pub_seq, __ATOMIC_ACQUIRE);
+        memcpy(con, &p->con_pub, sizeof(USB_ControllerReport_Input_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&p->con_pub_seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || (before != after));
+}
+
+/* Begin a bulk binary dump of records [first, first + count).
+ *  Replies with the number of records, the number of data bytes and the
+ *  state the first record is relative to.  Data then follows in
+ *  BOP_REC_DATA chunks, one per credit granted with BOP_CREDIT, and ends with
+ *  BOP_REC_END carrying the CRC-16 of all the data.
+ */
+void rec_dump_start(player_t *p, uint32_t first, uint32_t count)
+{
+    uint8_t state[SWF_CON_LEN];
+    uint32_t run;
+    uint32_t records = 0;
+
+    // The ring can't be walked safely while it is still being written, or
+    // while a live stream is still draining it
+    if (p->recording || (p->rec_live && p->rec_used > 0))
+    {
+        frame_err_count++;
+        send_frame_int(BOP_NAK, frame_err_count);
+        return;
+    }
+
+    // Skip to the first requested record
+    unsigned int pos = p->rec_tail;
+    memcpy(state, p->rec_base, SWF_CON_LEN);
+    for (uint32_t i = 0; i < first && pos != p->rec_head; i++)
+    {
+        pos = (pos + rec_read(p, pos, state, &run)) % REC_BUFF_BYTES;
+    }
+
+    uint8_t resp[8 + SWF_CON_LEN];
+    memcpy(resp + 8, state, SWF_CON_LEN);
+
+    // Measure the requested records
+    unsigned int end = pos;
+    uint8_t last[SWF_CON_LEN];
+    memcpy(last, state, SWF_CON_LEN);
+    while (records < count && end != p->rec_head)
+    {
+        end = (end + rec_read(p, end, last, &run)) % REC_BUFF_BYTES;
+        records++;
+    }
+
+    dump_pos = pos;
+    dump_ring_left = (end + REC_BUFF_BYTES - pos) % REC_BUFF_BYTES;
+
+    // The unfinished run goes at the end if the range reaches it
+    dump_extra_len = 0;
+    dump_extra_sent = 0;
+    if (records < count && p->rec_run > 0)
+    {
+        pack_con(&p->rec_cur, state);
+        dump_extra_len = rec_encode(last, state, p->rec_run, dump_extra);
+        records++;
+    }
+
+    dump_player = p;
+    dump_total = dump_ring_left + dump_extra_len;
+    dump_credits = 0;
+    dump_seq = 0;
+    dump_crc = 0xFFFF;
+    dump_active = true;
+
+    put_be32(resp, records);
+    put_be32(resp + 4, dump_total);
+    send_frame(BOP_REC_DUMP | BOP_REPLY, resp, sizeof(resp));
+}
+
+/* Send dump chunks while the host has granted credits.
+ *  Called from the main loop; never waits for the serial link.
+ */
+void rec_dump_task()
+{
+    uint8_t payload[2 + REC_DUMP_CHUNK];
+    uint8_t enc[SWF_MAX_ENCODED];
+
+    while (dump_active && dump_credits > 0)
+    {
+        uint32_t left = dump_ring_left + (dump_extra_len - dump_extra_sent);
+
+        if (left == 0)
+        {
+            uint8_t resp[6];
+            put_be16(resp, dump_crc);
+            put_be32(resp + 2, dump_total);
+            size_t enc_len = swf_encode(BOP_REC_END | BOP_REPLY, resp, sizeof(resp), enc);
+            if (hal_uart_try_write(enc, enc_len))
+                dump_active = false;
+            return;
+        }
+
+        // Gather a chunk from the ring, then from the unfinished run.
+        // Recording can't restart during a dump (REC is a text command), but
+        // the ring is still shared with the frame interrupt.
+        size_t n = 0;
+        put_be16(payload, dump_seq);
+        uint32_t irq_state = hal_irq_save();
+        for (unsigned int pos = dump_pos; n < REC_DUMP_CHUNK && n < dump_ring_left; n++)
+        {
+            payload[2 + n] = dump_player->rec_buff[pos];
+            pos = (pos + 1) % REC_BUFF_BYTES;
+        }
+        hal_irq_restore(irq_state);
+        size_t ring_n = n;
+        for (uint8_t i = dump_extra_sent; n < REC_DUMP_CHUNK && i < dump_extra_len; i++, n++)
+        {
+            payload[2 + n] = dump_extra[i];
+        }
+
+        size_t enc_len = swf_encode(BOP_REC_DATA | BOP_REPLY, payload, 2 + n, enc);
+        if (!hal_uart_try_write(enc, enc_len))
+            return; // try again once the TX ring drains
+
+        dump_crc = swf_crc16_update(dump_crc, payload + 2, n);
+        dump_pos = (dump_pos + ring_n) % REC_BUFF_BYTES;
+        dump_ring_left -= ring_n;
+        dump_extra_sent += n - ring_n;
+        dump_seq++;
+        dump_credits--;
+    }
+}
+
+//--------------------------------------------------------------------
+// Frame update
+//--------------------------------------------------------------------
+
+/* Advance one player's playback and recording by one game frame.
+ */
+static void player_frame(player_t *p)
+{
+    // If playing back, move the queue pointers and send the next entry
+    if (p->action_mode == A_PLAY)
+    {
+        unsigned int tail = p->queue_tail; // only written here
+        // Increment tail as long as buffer isn't empty, wrapping when needed
+        if (tail != __atomic_load_n(&p->queue_head, __ATOMIC_ACQUIRE))
+        {
+            tail = (tail + 1) & CON_BUFF_MASK;
+        }
+        // Copy the current entry to the USB data
+        memcpy(&p->current_con, &(p->con_data_buff[tail]), sizeof(USB_ControllerReport_Input_t));
+        // Only now may the producer reuse the previous entry
+        __atomic_store_n(&p->queue_tail, tail, __ATOMIC_RELEASE);
+
+        queue_mark_check(p);
+    }
+    // If playing in lag mode, catch up on states that came due since the
+    // last release so the recording sees them
+    else if (p->action_mode == A_LAG)
+    {
+        lag_drain(p);
+    }
+    // If playing a movie from flash, send its next frame
+    else if (p->action_mode == A_MOVIE)
+    {
+        if (!movie_frame(&p->current_con))
+        {
+            // End of the movie; let go of the controls
+            memcpy(&p->current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+            p->action_mode = A_RT;
+        }
+    }
+    // If running a macro, step it to its next frame
+    else if (p->action_mode == A_MACRO)
+    {
+        if (!macro_frame(p, &p->current_con))
+        {
+            memcpy(&p->current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+            p->action_mode = A_RT;
+        }
+    }
+
+    // If recording, copy real-time buffer to record buffer
+    if (p->recording)
+    {
+        // Implement run-length encoding.  Live runs are kept to one line each.
+        uint32_t run_max = p->rec_live ? REC_LINE_MAX : 0xFFFFFFFF;
+        if ((p->rec_run < run_max) && (are_cons_equal(p->rec_cur, p->current_con))) {
+            // One more of the same
+            p->rec_run += 1;
+        } else {
+            // Controller data has changed (or a live run is full); store the finished run.
+            rec_close_run(p);
+            memcpy(&p->rec_cur, &p->current_con, sizeof(USB_ControllerReport_Input_t));
+            p->rec_run = 1;
+        }
+    }
+
+    // Mark the new state as ready for the USB side
+    con_publish(p);
+}
+
+/* Advance playback and recording by one game frame.
+ *  Called from the frame timer interrupt.  All players move on the same tick.
+ */
+void frame_update(void)
+{
+    uint64_t start_us = hal_time_us();
+
+    // Scheduled states land before the players advance to this frame
+    sched_run(frame_seq);
+
+    for (int n = 0; n < SWICC_PLAYERS; n++)
+    {
+        player_frame(&players[n]);
+    }
+
+    frame_time_us = hal_time_us();
+
+    // Traced under the same number sched_run was given
+    trace_frame(start_us);
+
+    frame_seq++;
+}
+
+//--------------------------------------------------------------------
+// Helpers
+//--------------------------------------------------------------------
+
+// Big-endian field access for binary payloads
+void put_be16(uint8_t *out, uint16_t val) {
+    out[0] = val >> 8;
+    out[1] = val & 0xFF;
+}
+
+void put_be32(uint8_t *out, uint32_t val) {
+    out[0] = val >> 24;
+    out[1] = (val >> 16) & 0xFF;
+    out[2] = (val >> 8) & 0xFF;
+    out[3] = val & 0xFF;
+}
+
+uint32_t get_be32(const uint8_t *in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+// Value of each hex digit (either case) with HEX_VALID set, zero otherwise
+#define HEX_VALID 0x10
+static const uint8_t hex_table[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F,
+    ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F
+};
+
+/* Convert pairs of hex characters into up to len bytes.
+ *  Validation and conversion happen in the same pass.  Stops at the first
+ *  character that is not a hex digit (including the terminator) and returns
+ *  the number of whole bytes decoded.
+ */
+size_t hex_decode(const char *ch, uint8_t *out, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        uint8_t hi = hex_table[(uint8_t)ch[0]];
+        if (!(hi & HEX_VALID))
+            break;
+        uint8_t lo = hex_table[(uint8_t)ch[1]];
+        if (!(lo & HEX_VALID))
+            break;
+        out[i] = (hi << 4) | (lo & 0x0F);
+        ch += 2;
+    }
+    return i;
+}
+
+// Compare two instances of the USB_ControllerReport_Input_t structure
+bool are_cons_equal(USB_ControllerReport_Input_t a, USB_ControllerReport_Input_t b) {
+    if (a.Button != b.Button) return false;
+    if (a.HAT != b.HAT) return false;
+    if (a.LX != b.LX) return false;
+    if (a.LY != b.LY) return false;
+    if (a.RX != b.RX) return false;
+    if (a.RY != b.RY) return false;
+    if (a.VendorSpec != b.VendorSpec) return false;
+    return true;
+}
@@ -0,0 +1,293 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_CORE_H_
+#define SWICC_CORE_H_
+
+/* Hardware-independent SwiCC logic: the playback queue, lag, recording,
+ *  controller state parsing and command handling.  Anything that touches the
+ *  RP2040 goes through the functions in swicc_hal.h, so this builds on a host.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "swicc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Controller HID report structure.
+typedef struct {
+	uint16_t Button; // 16 buttons;
+	uint8_t  HAT;    // HAT switch; one nibble w/ unused nibble
+	uint8_t  LX;     // Left  Stick X
+	uint8_t  LY;     // Left  Stick Y
+	uint8_t  RX;     // Right Stick X
+	uint8_t  RY;     // Right Stick Y
+	uint8_t  VendorSpec;
+} USB_ControllerReport_Input_t;
+
+// The output is structured as a mirror of the input.
+typedef struct {
+	uint16_t Button; // 16 buttons;
+	uint8_t  HAT;    // HAT switch; one nibble w/ unused nibble
+	uint8_t  LX;     // Left  Stick X
+	uint8_t  LY;     // Left  Stick Y
+	uint8_t  RX;     // Right Stick X
+	uint8_t  RY;     // Right Stick Y
+} USB_ControllerReport_Output_t;
+
+// Type Defines
+// Enumeration for controller buttons.
+typedef enum {
+	KEY_Y       = 0x01,
+	KEY_B       = 0x02,
+	KEY_A       = 0x04,
+	KEY_X       = 0x08,
+	KEY_L       = 0x10,
+	KEY_R       = 0x20,
+	KEY_ZL      = 0x40,
+	KEY_ZR      = 0x80,
+	KEY_SELECT  = 0x100,
+	KEY_START   = 0x200,
+	KEY_LCLICK  = 0x400,
+	KEY_RCLICK  = 0x800,
+	KEY_HOME    = 0x1000,
+	KEY_CAPTURE = 0x2000,
+} ControllerButtons_t;
+
+// Action state
+enum {
+	A_PLAY, // play from buffer
+	A_RT,   // real-time
+	A_LAG,  // lag
+	A_STOP, // stop
+	A_MOVIE, // play the movie stored in flash
+	A_MACRO  // run a macro (see swicc_macro.h)
+};
+
+// Serial control information
+enum {
+    C_IDLE,        // nothing happening
+    C_ACTIVATED,   // activated by command character
+    C_Q,           // receiving a controller state for queue
+    C_I,           // receiving an immediate controller state
+	C_F,           // request for queue buffer fill amount
+	C_M,           // mode change
+	C_R,           // request to read from record buffer 
+	C_D            // receiving a new delay value
+};
+
+
+
+#define CMD_CHAR '+'
+#define CMD_STR_LEN 256
+
+#define BAUD_RATE 115200
+#define BAUD_CONFIRM_MS 1000
+
+// Number of controllers, each its own HID interface (set by the build)
+#ifndef SWICC_PLAYERS
+#define SWICC_PLAYERS 1
+#endif
+#if (SWICC_PLAYERS < 1) || (SWICC_PLAYERS > 4)
+#error "SWICC_PLAYERS must be between 1 and 4"
+#endif
+
+#define CON_BUFF_LEN 256 // must be a power of two
+#define CON_BUFF_MASK (CON_BUFF_LEN - 1)
+// Lagged states waiting per player
+#define LAG_BUFF_LEN 256 // must be a power of two
+#define LAG_BUFF_MASK (LAG_BUFF_LEN - 1)
+// Longest lag, in microseconds
+#define LAG_MAX_US 10000000
+// Recording buffer size in bytes per player (see swicc_rec.h for the format);
+// the players share one fixed amount of RAM
+#define REC_BUFF_BYTES ((16384 * 9) / SWICC_PLAYERS)
+// Longest run reported on one line of recording readout
+#define REC_LINE_MAX 240
+// Recording bytes per binary dump chunk
+#define REC_DUMP_CHUNK 240
+
+// Most states accepted by one batch command (limited by the line length)
+#define QB_MAX_FRAMES ((CMD_STR_LEN - 4) / 14)
+
+// A lagged state and when it arrived (low 32 bits of the microsecond clock)
+typedef struct {
+    uint32_t stamp_us;
+    USB_ControllerReport_Input_t con;
+} lag_event_t;
+
+// Running latency statistics, in microseconds
+typedef struct {
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} lat_stat_t;
+
+// Everything that belongs to one controller: its published state, mode,
+// playback queue, lag buffer and recording.
+typedef struct {
+    // current_con is the working copy owned by the frame interrupt; each
+    // finished state is copied to con_pub under a sequence counter (odd while
+    // a copy is in progress) so readers never see a mix of two frames.
+    USB_ControllerReport_Input_t current_con;
+    USB_ControllerReport_Input_t con_pub;
+    uint32_t con_pub_seq;
+    uint8_t action_mode;
+
+    // The playback queue is a single-producer/single-consumer ring.  The
+    // command parser only writes queue_head and the frame update only writes
+    // queue_tail; each side publishes its index with release ordering after
+    // touching the entries.  queue_head is the newest entry and queue_tail is
+    // the one now playing.
+    USB_ControllerReport_Input_t con_data_buff[CON_BUFF_LEN];
+    unsigned int queue_tail, queue_head;
+    unsigned int queue_rejected; // states refused because the queue was full
+
+    // Queue watermarks.  The frame update tells the host when the fill falls
+    // to the low mark or reaches the high mark; 0 disables a mark.  Each is
+    // re-armed once the fill moves back across it.
+    unsigned int queue_low_mark, queue_high_mark;
+    bool queue_low_armed, queue_high_armed;
+
+    // Lag delay line, used only by the lagged mode.  States wait from
+    // lag_tail up to lag_head until lag_us has passed since they arrived.
+    // Both ends are only touched with interrupts held off.
+    lag_event_t lag_buff[LAG_BUFF_LEN];
+    unsigned int lag_tail, lag_head;
+    uint32_t lag_us;
+
+    // Recording ring.  Closed runs are stored as compact records (see
+    // swicc_rec.h) from rec_tail up to rec_head; the run in progress is
+    // rec_cur x rec_run.
+    uint8_t rec_buff[REC_BUFF_BYTES];
+    unsigned int rec_head, rec_tail, rec_used;
+    uint8_t rec_base[SWF_CON_LEN]; // state that the oldest record is relative to
+    uint8_t rec_last[SWF_CON_LEN]; // state of the newest record
+    USB_ControllerReport_Input_t rec_cur;
+    uint32_t rec_run;
+    bool recording;
+    bool recording_wrap;
+
+    // Live streaming of the recording
+    bool rec_live;
+    unsigned int rec_live_lost;     // runs dropped before they could be sent
+    unsigned int rec_lost_reported; // rec_live_lost last sent to the host
+
+    // Recording readout position
+    unsigned int stream_pos;
+    uint8_t stream_state[SWF_CON_LEN];
+    uint32_t stream_left; // frames of the current record not yet sent
+    bool stream_open;     // the run in progress has been taken for sending
+} player_t;
+
+//--------------------------------------------------------------------
+// Shared state
+//--------------------------------------------------------------------
+
+extern USB_ControllerReport_Input_t neutral_con;
+extern player_t players[SWICC_PLAYERS];
+extern player_t *cmd_player;
+
+extern unsigned int frame_delay_us;
+extern bool vsync_en;
+
+extern bool usb_connected;
+extern bool led_on;
+extern uint8_t vsync_count;
+
+extern bool binary_mode;
+extern uint16_t frame_err_count;
+
+extern unsigned int baud_rate;
+
+extern volatile uint32_t frame_seq;
+extern volatile uint64_t frame_time_us;
+extern lat_stat_t lat_submit, lat_complete;
+
+//--------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------
+
+unsigned int player_index(const player_t* p);
+const char* player_suffix(const player_t* p);
+void buffer_init();
+void process_rx_char(uint8_t ch);
+void process_command(char* cmd_str);
+const char* command_name(unsigned int index);
+int set_frame_delay(const char* cstr);
+int add_to_queue(player_t* p, const char* cstr);
+int force_con_state(player_t* p, const char* cstr);
+int parse_con_state(const char* cstr, USB_ControllerReport_Input_t* con);
+void pack_con(const USB_ControllerReport_Input_t* con, uint8_t* data);
+void unpack_con(const uint8_t* data, USB_ControllerReport_Input_t* con);
+bool queue_con(player_t* p, const USB_ControllerReport_Input_t* con);
+int queue_batch(player_t* p, const char* cstr);
+int queue_con_batch(player_t* p, const USB_ControllerReport_Input_t* cons, int count);
+void queue_clear(player_t* p);
+void queue_drain(player_t* p);
+int add_to_lag(player_t* p, const char* cstr);
+void lag_con(player_t* p, const USB_ControllerReport_Input_t* con);
+void lag_release(player_t* p);
+void set_lag_us(player_t* p, uint32_t us);
+void set_con_state(player_t* p, const USB_ControllerReport_Input_t* con);
+void con_publish(player_t* p);
+void con_read(player_t* p, USB_ControllerReport_Input_t* con);
+unsigned int get_queue_fill(player_t* p);
+void set_queue_marks(player_t* p, int low, int high);
+void queue_mark_check(player_t* p);
+void request_baud(unsigned int rate);
+void baud_task();
+void uart_resp_int(const char* header, unsigned int msg);
+void uart_resp_long(const char* header, uint32_t msg);
+void send_recording_entry(const uint8_t* state, uint8_t count);
+void send_recording(player_t* p);
+void rec_start(player_t* p);
+void rec_close_run(player_t* p);
+void rec_drop_oldest(player_t* p);
+void rec_live_task();
+void rec_dump_start(player_t* p, uint32_t first, uint32_t count);
+void rec_dump_task();
+unsigned int rec_read(player_t* p, unsigned int pos, uint8_t* state, uint32_t* run);
+void send_frame(uint8_t opcode, const uint8_t* payload, size_t len);
+void send_frame_int(uint8_t opcode, uint16_t msg);
+void process_frame(const uint8_t* frame, int len);
+void frame_update(void);
+void lat_add(lat_stat_t* stat, uint32_t us);
+void send_latency();
+void put_be16(uint8_t* out, uint16_t val);
+void put_be32(uint8_t* out, uint32_t val);
+uint32_t get_be32(const uint8_t* in);
+size_t hex_decode(const char* ch, uint8_t* out, size_t len);
+bool are_cons_equal(USB_ControllerReport_Input_t a, USB_ControllerReport_Input_t b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_CORE_H_ */
@@ -0,0 +1,105 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_FRAME_H_
+#define SWICC_FRAME_H_
+
+/* Binary serial framing.
+ *  A frame is [opcode][payload...][CRC16 hi][CRC16 lo], COBS-encoded and
+ *  terminated by a 0x00 byte.  The CRC is CRC-16/CCITT-FALSE over the opcode
+ *  and payload.  Nothing in here depends on the Pico SDK so it can be built
+ *  and exercised on a host machine.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest decoded frame (opcode + payload + CRC)
+#define SWF_MAX_FRAME   256
+// Largest payload that fits in a frame
+#define SWF_MAX_PAYLOAD (SWF_MAX_FRAME - 3)
+// Largest encoded frame, including COBS overhead and the delimiter
+#define SWF_MAX_ENCODED (SWF_MAX_FRAME + (SWF_MAX_FRAME / 254) + 2)
+
+// Size of a controller state on the wire
+#define SWF_CON_LEN 7
+
+// Frame delimiter
+#define SWF_DELIM 0x00
+
+// Binary opcodes (host to device)
+enum {
+    BOP_QUEUE = 0x01, // add a controller state to the queue
+    BOP_QUEUE_LAG,    // add a controller state to the lagged queue
+    BOP_IMM,          // set the immediate controller state
+    BOP_GQF,          // request queue buffer fill amount
+    BOP_QUEUE_BATCH,  // add several controller states to the queue
+    BOP_REC_DUMP,     // start a bulk dump of the recording
+    BOP_CREDIT,       // allow the device to send more dump chunks
+    BOP_REC_DATA,     // (device to host) a chunk of recording data
+    BOP_REC_END,      // (device to host) end of dump, with checksum
+    BOP_MOVIE_DATA,   // add data to the movie being uploaded
+    BOP_MOVIE_END,    // (device to host) movie playback finished
+    BOP_TRACE,        // export the timing trace
+    BOP_QWM,          // set the queue low and high watermarks
+    BOP_QMARK,        // (device to host) the queue crossed a watermark
+    BOP_PLAYER,       // choose the player that later frames act on
+    BOP_GFC,          // request the frame counter
+    BOP_AT,           // schedule a controller state for an absolute frame
+    BOP_MACRO,        // run or stop a macro
+    BOP_MACRO_END,    // (device to host) a macro finished
+    BOP_ASCII = 0x1F, // leave binary mode
+    BOP_NAK = 0x7F    // (device to host) a frame was rejected
+};
+
+// Set in the opcode of a device-to-host reply
+#define BOP_REPLY 0x80
+
+// Return values from swf_decode_byte
+#define SWF_PENDING 0
+#define SWF_ERROR   (-1)
+
+// Incremental frame decoder state.
+typedef struct {
+    uint8_t buf[SWF_MAX_ENCODED];
+    uint16_t len;
+    bool overflow;
+} swf_decoder_t;
+
+uint16_t swf_crc16(const uint8_t *data, size_t len);
+uint16_t swf_crc16_update(uint16_t crc, const uint8_t *data, size_t len);
+void swf_decoder_reset(swf_decoder_t *dec);
+int swf_decode_byte(swf_decoder_t *dec, uint8_t ch);
+size_t swf_encode(uint8_t opcode, const uint8_t *payload, size_t len, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_FRAME_H_ */
@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_HAL_H_
+#define SWICC_HAL_H_
+
+/* Platform functions used by the core logic.
+ *  The firmware implements these in SwiCC_RP2040.c; a host build supplies its
+ *  own versions.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Queue serial output, waiting only if the transmit buffer is full.
+void hal_uart_write(const uint8_t *data, size_t len);
+void hal_uart_puts(const char *str);
+// Queue serial output without waiting; false if it did not all fit.
+bool hal_uart_try_write(const uint8_t *data, size_t len);
+// Change the serial baud rate after pending output has been sent.
+void hal_set_baud(unsigned int rate);
+// Number of received bytes lost to overruns.
+unsigned int hal_rx_overruns(void);
+
+// Free-running microsecond clock.
+uint64_t hal_time_us(void);
+
+// Hold off the frame interrupt (and the other core) around shared updates.
+// Not reentrant.
+uint32_t hal_irq_save(void);
+void hal_irq_restore(uint32_t state);
+
+// Movie storage in flash.  The data is readable through the returned
+// pointer; erases are MOVIE_SECTOR and programs MOVIE_PAGE bytes, both at
+// aligned offsets.  Frames and serial interrupts stall while these run.
+uint32_t hal_movie_capacity(void);
+const uint8_t *hal_movie_data(void);
+void hal_movie_erase(uint32_t offset);
+void hal_movie_program(uint32_t offset, const uint8_t *page);
+
+// Switch between VSYNC-triggered frames and the free-running frame timer.
+void hal_vsync_enable(bool en);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_HAL_H_ */
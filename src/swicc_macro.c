@@ -0,0 +1,532 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "swicc_macro.h"
+#include "swicc_frame.h"
+#include "swicc_hal.h"
+
+// Playback state of one player's macro
+typedef struct {
+    uint8_t macro;   // slot in macros plus 1, or 0 if none
+    uint16_t pc;     // next instruction, from the start of the macro
+    uint8_t hold;    // frames left of the current step
+    uint8_t depth;   // loops entered
+    uint16_t loop_pc[MACRO_DEPTH];
+    uint16_t loop_left[MACRO_DEPTH]; // passes left, or 0 to loop forever
+    uint32_t frames; // frames played so far
+} macro_run_t;
+
+// A macro being compiled.  Work is done on a copy so a line with an error
+// leaves the macro as it was.
+typedef struct {
+    uint8_t *code;
+    uint16_t len;
+    uint16_t room; // most bytes len may reach
+    uint8_t open;
+    uint16_t loop_at[MACRO_DEPTH];
+} macro_build_t;
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+macro_t macros[MACRO_COUNT];
+uint8_t macro_pool[MACRO_POOL];
+uint16_t macro_used = 0;
+
+// Slot of the macro MADD appends to (always the last in the pool), or -1
+int macro_last = -1;
+
+// Playback state, touched only with interrupts held off
+macro_run_t macro_runs[SWICC_PLAYERS];
+volatile bool macro_ended[SWICC_PLAYERS];
+
+//--------------------------------------------------------------------
+// Compiler
+//--------------------------------------------------------------------
+
+static bool valid_name(const char *name)
+{
+    size_t len = strlen(name);
+
+    if (len == 0 || len > MACRO_NAME_LEN)
+        return false;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_')
+            return false;
+    }
+    return true;
+}
+
+// Read a decimal number from 0 to 65535
+static bool parse_count(const char **s, uint32_t *val)
+{
+    const char *c = *s;
+    uint32_t n = 0;
+
+    if (!isdigit((unsigned char)*c))
+        return false;
+    while (isdigit((unsigned char)*c))
+    {
+        n = n * 10 + (*c++ - '0');
+        if (n > 0xFFFF)
+            return false;
+    }
+    *s = c;
+    *val = n;
+    return true;
+}
+
+static bool emit(macro_build_t *b, const uint8_t *bytes, uint16_t len)
+{
+    if (len > b->room - b->len)
+        return false;
+    memcpy(b->code + b->len, bytes, len);
+    b->len += len;
+    return true;
+}
+
+// Keep the current state for some frames, in steps of up to 255
+static bool emit_wait(macro_build_t *b, uint32_t frames)
+{
+    while (frames > 0)
+    {
+        uint8_t op[2] = {MOP_WAIT, frames > 255 ? 255 : frames};
+        if (!emit(b, op, sizeof(op)))
+            return false;
+        frames -= op[1];
+    }
+    return true;
+}
+
+/* Compile one line of macro text, appending to b.
+ *  Items are separated by spaces:
+ *    <state>[:frames]  a 6- or 14-digit controller state, for 1 frame or the
+ *                      given number
+ *    =:frames          keep the current state
+ *    [                 start a loop
+ *    ]count            end a loop, after count passes (0 for forever)
+ *  Loops may stay open at the end of the line and be closed by a later one.
+ */
+static uint8_t compile(macro_build_t *b, const char *src)
+{
+    const char *s = src;
+
+    while (true)
+    {
+        while (*s == ' ')
+            s++;
+        if (*s == 0)
+            return MACRO_OK;
+
+        if (*s == '[')
+        {
+            uint8_t op[3] = {MOP_LOOP, 0, 0};
+            if (b->open == MACRO_DEPTH)
+                return MACRO_ERR;
+            b->loop_at[b->open++] = b->len + 1;
+            if (!emit(b, op, sizeof(op)))
+                return MACRO_FULL;
+            s++;
+        }
+        else if (*s == ']')
+        {
+            uint32_t count;
+            uint8_t op = MOP_NEXT;
+            s++;
+            if (b->open == 0 || !parse_count(&s, &count))
+                return MACRO_ERR;
+            uint16_t at = b->loop_at[--b->open];
+            // A loop must hold at least one frame
+            if (b->len == at + 2)
+                return MACRO_ERR;
+            b->code[at] = count >> 8;
+            b->code[at + 1] = count & 0xFF;
+            if (!emit(b, &op, 1))
+                return MACRO_FULL;
+        }
+        else
+        {
+            uint8_t op[9];
+            uint16_t len;
+            uint32_t frames = 1;
+
+            if (*s == '=')
+            {
+                s++;
+                len = 0;
+            }
+            else
+            {
+                uint8_t state[SWF_CON_LEN];
+                size_t n = hex_decode(s, state, SWF_CON_LEN);
+                s += n * 2;
+                if (isxdigit((unsigned char)*s))
+                    return MACRO_ERR;
+                if (n == SWF_CON_LEN)
+                {
+                    op[0] = MOP_STATE;
+                    memcpy(op + 1, state, SWF_CON_LEN);
+                    len = 9;
+                }
+                else if (n == 3)
+                {
+                    op[0] = MOP_BUTTONS;
+                    memcpy(op + 1, state, 3);
+                    len = 5;
+                }
+                else
+                    return MACRO_ERR;
+            }
+
+            if (*s == ':')
+            {
+                s++;
+                if (!parse_count(&s, &frames) || frames == 0)
+                    return MACRO_ERR;
+            }
+            else if (len == 0)
+                return MACRO_ERR; // "=" needs a duration
+
+            if (*s != ' ' && *s != ']' && *s != 0)
+                return MACRO_ERR;
+
+            if (len > 0)
+            {
+                // The state itself covers the first 255 frames
+                op[len - 1] = frames > 255 ? 255 : frames;
+                frames -= op[len - 1];
+                if (!emit(b, op, len))
+                    return MACRO_FULL;
+            }
+            if (!emit_wait(b, frames))
+                return MACRO_FULL;
+        }
+    }
+}
+
+//--------------------------------------------------------------------
+// Macro storage
+//--------------------------------------------------------------------
+
+/* Find a macro by name.  Returns its slot, or -1.
+ */
+int macro_find(const char *name)
+{
+    for (int i = 0; i < MACRO_COUNT; i++)
+    {
+        if (macros[i].name[0] != 0 && strcmp(macros[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Free a slot and close the gap it leaves in the pool.
+ *  extra bytes past macro_used (a macro still being compiled) move down with
+ *  the rest.  Any player running the macro stops.  Must be called with
+ *  interrupts held off.
+ */
+static void remove_slot(int slot, uint16_t extra)
+{
+    macro_t *m = &macros[slot];
+    uint16_t end = m->start + m->len;
+
+    for (int n = 0; n < SWICC_PLAYERS; n++)
+    {
+        if (macro_runs[n].macro == slot + 1)
+        {
+            macro_runs[n].macro = 0;
+            if (players[n].action_mode == A_MACRO)
+            {
+                players[n].action_mode = A_RT;
+                memcpy(&players[n].current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+                con_publish(&players[n]);
+            }
+        }
+    }
+
+    memmove(macro_pool + m->start, macro_pool + end, macro_used + extra - end);
+    for (int i = 0; i < MACRO_COUNT; i++)
+    {
+        if (macros[i].name[0] != 0 && macros[i].start >= end)
+            macros[i].start -= m->len;
+    }
+    macro_used -= m->len;
+    m->name[0] = 0;
+
+    if (macro_last == slot)
+        macro_last = -1;
+}
+
+/* Define a macro from a line of text (see compile), replacing any macro with
+ *  the same name.  More can be added with macro_append.
+ */
+uint8_t macro_define(const char *name, const char *src)
+{
+    macro_build_t b = {0};
+    int old = macro_find(name);
+    int slot = old;
+
+    if (!valid_name(name))
+        return MACRO_ERR;
+
+    if (slot < 0)
+    {
+        for (slot = 0; slot < MACRO_COUNT && macros[slot].name[0] != 0; slot++)
+            ;
+        if (slot == MACRO_COUNT)
+            return MACRO_FULL;
+    }
+
+    // Compile into the free space at the end of the pool
+    b.code = macro_pool + macro_used;
+    b.room = MACRO_POOL - macro_used;
+    uint8_t result = compile(&b, src);
+    if (result != MACRO_OK)
+        return result;
+
+    uint32_t irq_state = hal_irq_save();
+    if (old >= 0)
+        remove_slot(old, b.len);
+    macro_t *m = &macros[slot];
+    strcpy(m->name, name);
+    m->start = macro_used;
+    m->len = b.len;
+    m->open = b.open;
+    memcpy(m->loop_at, b.loop_at, sizeof(m->loop_at));
+    macro_used += b.len;
+    macro_last = slot;
+    hal_irq_restore(irq_state);
+
+    return MACRO_OK;
+}
+
+/* Add a line of text to the macro defined last.
+ *  The macro may be running; new bytecode only becomes visible to it once
+ *  complete.
+ */
+uint8_t macro_append(const char *src)
+{
+    if (macro_last < 0)
+        return MACRO_ERR;
+
+    macro_t *m = &macros[macro_last];
+    macro_build_t b;
+    b.code = macro_pool + m->start;
+    b.len = m->len;
+    b.room = MACRO_POOL - m->start;
+    b.open = m->open;
+    memcpy(b.loop_at, m->loop_at, sizeof(b.loop_at));
+
+    uint8_t result = compile(&b, src);
+    if (result != MACRO_OK)
+        return result;
+
+    uint32_t irq_state = hal_irq_save();
+    macro_used += b.len - m->len;
+    m->len = b.len;
+    m->open = b.open;
+    memcpy(m->loop_at, b.loop_at, sizeof(m->loop_at));
+    hal_irq_restore(irq_state);
+
+    return MACRO_OK;
+}
+
+/* Delete a macro, stopping any player running it.
+ */
+bool macro_delete(const char *name)
+{
+    int slot = macro_find(name);
+
+    if (slot < 0)
+        return false;
+
+    uint32_t irq_state = hal_irq_save();
+    remove_slot(slot, 0);
+    hal_irq_restore(irq_state);
+
+    return true;
+}
+
+//--------------------------------------------------------------------
+// Playback
+//--------------------------------------------------------------------
+
+/* Start running a macro from the beginning on a player.
+ *  Returns false if there is no such macro or it still has loops open.
+ */
+bool macro_run(player_t *p, const char *name)
+{
+    int slot = macro_find(name);
+
+    if (slot < 0 || macros[slot].open != 0 || macros[slot].len == 0)
+        return false;
+
+    uint32_t irq_state = hal_irq_save();
+    macro_run_t *r = &macro_runs[player_index(p)];
+    memset(r, 0, sizeof(macro_run_t));
+    r->macro = slot + 1;
+    macro_ended[player_index(p)] = false;
+    p->action_mode = A_MACRO;
+    hal_irq_restore(irq_state);
+
+    return true;
+}
+
+/* Stop a player's macro, if one is running, and return to real-time mode.
+ */
+void macro_stop(player_t *p)
+{
+    uint32_t irq_state = hal_irq_save();
+    macro_halt(p);
+    hal_irq_restore(irq_state);
+}
+
+/* As macro_stop, for callers that already hold interrupts off.
+ */
+void macro_halt(player_t *p)
+{
+    if (p->action_mode == A_MACRO)
+    {
+        p->action_mode = A_RT;
+        memcpy(&p->current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        con_publish(p);
+    }
+}
+
+/* Produce the next frame of a player's macro into con.
+ *  Called from the frame interrupt.  con keeps its value through MOP_WAIT, so
+ *  it should be the player's current state.  Returns false once the macro has
+ *  ended.
+ */
+bool macro_frame(player_t *p, USB_ControllerReport_Input_t *con)
+{
+    macro_run_t *r = &macro_runs[player_index(p)];
+
+    if (r->macro != 0)
+    {
+        if (r->hold > 0)
+        {
+            r->hold--;
+            r->frames++;
+            return true;
+        }
+
+        const macro_t *m = &macros[r->macro - 1];
+        const uint8_t *code = macro_pool + m->start;
+
+        // Bounded, in case a loop never reaches a frame
+        for (int step = 0; step < MACRO_STEPS && r->pc < m->len; step++)
+        {
+            const uint8_t *op = code + r->pc;
+            switch (op[0])
+            {
+            case MOP_STATE:
+                unpack_con(op + 1, con);
+                r->hold = op[8] - 1;
+                r->pc += 9;
+                r->frames++;
+                return true;
+
+            case MOP_BUTTONS:
+                memcpy(con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+                con->Button = (op[1] << 8) | op[2];
+                con->HAT = op[3];
+                r->hold = op[4] - 1;
+                r->pc += 5;
+                r->frames++;
+                return true;
+
+            case MOP_WAIT:
+                r->hold = op[1] - 1;
+                r->pc += 2;
+                r->frames++;
+                return true;
+
+            case MOP_LOOP:
+                r->pc += 3;
+                r->loop_pc[r->depth] = r->pc;
+                r->loop_left[r->depth] = (op[1] << 8) | op[2];
+                r->depth++;
+                break;
+
+            case MOP_NEXT:
+                if (r->loop_left[r->depth - 1] == 0 || --r->loop_left[r->depth - 1] > 0)
+                    r->pc = r->loop_pc[r->depth - 1];
+                else
+                {
+                    r->depth--;
+                    r->pc++;
+                }
+                break;
+
+            default:
+                r->pc = m->len;
+                break;
+            }
+        }
+    }
+
+    r->macro = 0;
+    macro_ended[player_index(p)] = true;
+    return false;
+}
+
+/* Tell the host when a macro finishes on its own.
+ *  Called from the main loop.
+ */
+void macro_task()
+{
+    for (int n = 0; n < SWICC_PLAYERS; n++)
+    {
+        char msgstr[24];
+        uint8_t enc[SWF_MAX_ENCODED];
+        size_t len;
+
+        if (!macro_ended[n])
+            continue;
+
+        if (binary_mode)
+        {
+            uint8_t resp[5];
+            put_be32(resp, macro_runs[n].frames);
+            resp[4] = n;
+            len = swf_encode(BOP_MACRO_END | BOP_REPLY, resp, n > 0 ? 5 : 4, enc);
+        }
+        else
+        {
+            len = sprintf(msgstr, "+MEND%s %08X\r\n", player_suffix(&players[n]), (unsigned int)macro_runs[n].frames);
+            memcpy(enc, msgstr, len);
+        }
+
+        // Try again next time if the transmit buffer is full
+        if (hal_uart_try_write(enc, len))
+            macro_ended[n] = false;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_MACRO_H_
+#define SWICC_MACRO_H_
+
+/* Input macros.
+ *  A macro is a named sequence of controller states with durations, loops
+ *  and repeat counts.  It is uploaded as text (see macro_define) and compiled
+ *  to bytecode that the frame update steps through, one frame at a time:
+ *    MOP_STATE [7-byte state] [frames]  show a state for 1-255 frames
+ *    MOP_BUTTONS [3 bytes] [frames]     the same, with the sticks neutral
+ *    MOP_WAIT [frames]                  keep the current state
+ *    MOP_LOOP [count hi] [count lo]     repeat up to the matching MOP_NEXT
+ *                                       count times, or forever if 0
+ *    MOP_NEXT
+ *  A macro ends when it runs off the end of its bytecode.  The bytecode of
+ *  all macros shares one RAM pool, kept packed in the order they were
+ *  defined.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "swicc_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MACRO_POOL     4096 // bytecode bytes shared by all macros
+#define MACRO_COUNT    16   // most macros defined at once
+#define MACRO_NAME_LEN 8    // longest name
+#define MACRO_DEPTH    4    // deepest loop nesting
+// Most instructions stepped in one frame before a macro is given up on
+#define MACRO_STEPS    64
+
+// Bytecode instructions
+enum {
+    MOP_STATE = 0x01,
+    MOP_BUTTONS,
+    MOP_WAIT,
+    MOP_LOOP,
+    MOP_NEXT
+};
+
+// Results of macro_define and macro_append
+enum {
+    MACRO_OK,
+    MACRO_ERR,  // bad name or syntax, or nothing to append to
+    MACRO_FULL  // out of pool space or macro slots
+};
+
+typedef struct {
+    char name[MACRO_NAME_LEN + 1]; // empty if the slot is free
+    uint16_t start, len;           // bytecode in macro_pool
+    uint8_t open;                  // loops not yet closed; can't run until 0
+    uint16_t loop_at[MACRO_DEPTH]; // offsets of the open loops' counts
+} macro_t;
+
+extern macro_t macros[MACRO_COUNT];
+extern uint16_t macro_used;
+extern int macro_last;
+
+uint8_t macro_define(const char* name, const char* src);
+uint8_t macro_append(const char* src);
+bool macro_delete(const char* name);
+int macro_find(const char* name);
+bool macro_run(player_t* p, const char* name);
+void macro_stop(player_t* p);
+void macro_halt(player_t* p);
+bool macro_frame(player_t* p, USB_ControllerReport_Input_t* con);
+void macro_task();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_MACRO_H_ */
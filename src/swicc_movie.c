@@ -0,0 +1,296 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "swicc_movie.h"
+#include "swicc_frame.h"
+#include "swicc_rec.h"
+#include "swicc_hal.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+uint8_t movie_status = MV_NONE;
+uint32_t movie_len = 0;    // bytes of record data
+uint32_t movie_frames = 0; // frames played so far
+uint8_t movie_base[SWF_CON_LEN];
+
+// Upload state.  Data is collected a page at a time before programming.
+uint8_t movie_page[MOVIE_PAGE];
+uint16_t movie_page_fill;
+uint32_t movie_written;
+
+// Playback state, touched only by the frame interrupt while playing.
+uint32_t movie_pos;
+uint32_t movie_run;
+uint8_t movie_state[SWF_CON_LEN];
+volatile bool movie_ended = false;
+
+// The player the movie is playing on, or was last played on
+player_t *movie_player = &players[0];
+
+//--------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------
+
+/* Look for a valid movie in flash.  Called once at startup.
+ */
+void movie_init()
+{
+    const uint8_t *hdr = hal_movie_data();
+
+    movie_status = MV_NONE;
+    movie_len = 0;
+
+    if (get_be32(hdr) != MOVIE_MAGIC)
+        return;
+
+    uint32_t len = get_be32(hdr + 4);
+    if (len > hal_movie_capacity() - MOVIE_PAGE)
+        return;
+
+    uint16_t crc = ((uint16_t)hdr[8] << 8) | hdr[9];
+    if (swf_crc16(hdr + MOVIE_PAGE, len) != crc)
+        return;
+
+    memcpy(movie_base, hdr + 10, SWF_CON_LEN);
+    movie_len = len;
+    movie_status = MV_READY;
+}
+
+/* Start a new upload, discarding the movie in flash.
+ *  base is the 7-byte state the first record is relative to.  Returns the
+ *  number of data bytes that will fit.
+ */
+uint32_t movie_begin(const uint8_t *base)
+{
+    movie_stop();
+
+    // Erasing the first sector also erases the header, invalidating the old movie
+    hal_movie_erase(0);
+
+    memcpy(movie_base, base, SWF_CON_LEN);
+    movie_page_fill = 0;
+    movie_written = 0;
+    movie_len = 0;
+    movie_status = MV_UPLOAD;
+
+    return hal_movie_capacity() - MOVIE_PAGE;
+}
+
+/* Program the collected page, padding it if it is not full.
+ */
+static void movie_flush_page()
+{
+    uint32_t offset = MOVIE_PAGE + movie_written - movie_page_fill;
+
+    if (movie_page_fill == 0)
+        return;
+
+    memset(movie_page + movie_page_fill, 0xFF, MOVIE_PAGE - movie_page_fill);
+
+    // Each sector is erased just before its first page is needed
+    if ((offset % MOVIE_SECTOR) == 0)
+        hal_movie_erase(offset);
+    hal_movie_program(offset, movie_page);
+
+    movie_page_fill = 0;
+}
+
+/* Append record data to the upload.
+ *  Returns the total bytes written so far, or -1 if no upload is in progress
+ *  or the data does not fit.
+ */
+int movie_write(const uint8_t *data, size_t len)
+{
+    if (movie_status != MV_UPLOAD)
+        return -1;
+    if (movie_written + len > hal_movie_capacity() - MOVIE_PAGE)
+        return -1;
+
+    while (len > 0)
+    {
+        size_t n = MOVIE_PAGE - movie_page_fill;
+        if (n > len)
+            n = len;
+        memcpy(movie_page + movie_page_fill, data, n);
+        movie_page_fill += n;
+        movie_written += n;
+        data += n;
+        len -= n;
+
+        if (movie_page_fill == MOVIE_PAGE)
+            movie_flush_page();
+    }
+
+    return movie_written;
+}
+
+/* Finish an upload.
+ *  The CRC-16 of the data read back from flash must match crc; only then is
+ *  the header written.  actual receives the CRC that was computed.
+ */
+bool movie_commit(uint16_t crc, uint16_t *actual)
+{
+    uint8_t hdr[MOVIE_PAGE];
+
+    *actual = 0;
+    if (movie_status != MV_UPLOAD)
+        return false;
+
+    movie_flush_page();
+
+    *actual = swf_crc16(hal_movie_data() + MOVIE_PAGE, movie_written);
+    if (*actual != crc)
+    {
+        movie_status = MV_NONE;
+        return false;
+    }
+
+    memset(hdr, 0xFF, sizeof(hdr));
+    put_be32(hdr, MOVIE_MAGIC);
+    put_be32(hdr + 4, movie_written);
+    put_be16(hdr + 8, crc);
+    memcpy(hdr + 10, movie_base, SWF_CON_LEN);
+    hal_movie_program(0, hdr);
+
+    movie_len = movie_written;
+    movie_status = MV_READY;
+
+    return true;
+}
+
+/* Start playing the movie from the beginning on a player.
+ *  There is only one movie, so it stops on any other player first.  Returns
+ *  false if there is no valid movie.
+ */
+bool movie_play(player_t *p)
+{
+    if (movie_status != MV_READY)
+        return false;
+
+    if (p != movie_player)
+        movie_stop();
+
+    uint32_t irq_state = hal_irq_save();
+    memcpy(movie_state, movie_base, SWF_CON_LEN);
+    movie_pos = 0;
+    movie_run = 0;
+    movie_frames = 0;
+    movie_ended = false;
+    movie_player = p;
+    p->action_mode = A_MOVIE;
+    hal_irq_restore(irq_state);
+
+    return true;
+}
+
+/* Stop playback, if the movie is playing, and return to real-time mode.
+ */
+void movie_stop()
+{
+    uint32_t irq_state = hal_irq_save();
+    movie_halt();
+    hal_irq_restore(irq_state);
+}
+
+/* As movie_stop, for callers that already hold interrupts off.
+ */
+void movie_halt()
+{
+    if (movie_player->action_mode == A_MOVIE)
+    {
+        movie_player->action_mode = A_RT;
+        memcpy(&movie_player->current_con, &neutral_con, sizeof(USB_ControllerReport_Input_t));
+        con_publish(movie_player);
+    }
+}
+
+/* Report the movie status, including whether it is playing.
+ */
+uint8_t movie_get_status()
+{
+    if (movie_player->action_mode == A_MOVIE)
+        return MV_PLAY;
+    return movie_status;
+}
+
+/* Produce the next frame of the movie.
+ *  Called from the frame interrupt.  Returns false once the movie has ended.
+ */
+bool movie_frame(USB_ControllerReport_Input_t *con)
+{
+    const uint8_t *data = hal_movie_data() + MOVIE_PAGE;
+
+    while (movie_run == 0)
+    {
+        int n = -1;
+        if (movie_pos < movie_len)
+            n = rec_decode(data + movie_pos, movie_len - movie_pos, movie_state, &movie_run);
+        if (n < 0)
+        {
+            movie_ended = true;
+            return false;
+        }
+        movie_pos += n;
+    }
+
+    unpack_con(movie_state, con);
+    movie_run--;
+    movie_frames++;
+
+    return true;
+}
+
+/* Tell the host when playback reaches the end of the movie.
+ *  Called from the main loop.
+ */
+void movie_task()
+{
+    char msgstr[24];
+    uint8_t enc[SWF_MAX_ENCODED];
+    size_t len;
+
+    if (!movie_ended)
+        return;
+
+    if (binary_mode)
+    {
+        uint8_t resp[4];
+        put_be32(resp, movie_frames);
+        len = swf_encode(BOP_MOVIE_END | BOP_REPLY, resp, sizeof(resp), enc);
+    }
+    else
+    {
+        len = sprintf(msgstr, "+MVEND %08X\r\n", (unsigned int)movie_frames);
+        memcpy(enc, msgstr, len);
+    }
+
+    // Try again next time if the transmit buffer is full
+    if (hal_uart_try_write(enc, len))
+        movie_ended = false;
+}
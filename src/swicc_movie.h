@@ -0,0 +1,80 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_MOVIE_H_
+#define SWICC_MOVIE_H_
+
+/* Flash-resident movies.
+ *  A movie is a sequence of records in the compact recording format (see
+ *  swicc_rec.h), stored in flash after one header page:
+ *    [magic "SWMV"] [data length, 4 bytes] [CRC-16, 2 bytes] [base state]
+ *  All values are big-endian, and the first record is relative to the 7-byte
+ *  base state.  The header is written last, only once the uploaded data has
+ *  passed its checksum, so a partial upload is never playable.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "swicc_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flash programming and erase granularity
+#define MOVIE_PAGE   256
+#define MOVIE_SECTOR 4096
+
+#define MOVIE_MAGIC 0x53574D56 // "SWMV"
+
+// Movie status
+enum {
+    MV_NONE,   // no valid movie in flash
+    MV_UPLOAD, // upload in progress
+    MV_READY,  // valid movie
+    MV_PLAY    // playing (reported only; see movie_get_status)
+};
+
+extern uint8_t movie_status;
+extern uint32_t movie_len;
+extern uint32_t movie_frames;
+extern uint32_t movie_written;
+
+void movie_init();
+uint32_t movie_begin(const uint8_t* base);
+int movie_write(const uint8_t* data, size_t len);
+bool movie_commit(uint16_t crc, uint16_t* actual);
+bool movie_play(player_t* p);
+void movie_stop();
+void movie_halt();
+uint8_t movie_get_status();
+bool movie_frame(USB_ControllerReport_Input_t* con);
+void movie_task();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_MOVIE_H_ */
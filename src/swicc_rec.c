@@ -0,0 +1,100 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "swicc_rec.h"
+
+/* Encode one run as a record.
+ *  prev is the state of the previous record and state is the state of this
+ *  run, both in the 7-byte wire format.  out must hold REC_MAX_RECORD bytes.
+ *  Returns the record length.
+ */
+size_t rec_encode(const uint8_t *prev, const uint8_t *state, uint32_t run, uint8_t *out)
+{
+    size_t len = 1;
+    uint8_t mask = 0;
+
+    for (uint8_t i = 0; i < SWF_CON_LEN; i++)
+    {
+        if (state[i] != prev[i])
+        {
+            mask |= 1u << i;
+            out[len++] = state[i];
+        }
+    }
+    out[0] = mask;
+
+    // Run length varint
+    while (run >= 0x80)
+    {
+        out[len++] = (run & 0x7F) | 0x80;
+        run >>= 7;
+    }
+    out[len++] = run;
+
+    return len;
+}
+
+/* Decode one record.
+ *  state holds the previous record's state on entry and is updated in place.
+ *  Returns the number of bytes consumed, or -1 if the record is malformed or
+ *  runs past len.
+ */
+int rec_decode(const uint8_t *data, size_t len, uint8_t *state, uint32_t *run)
+{
+    size_t pos = 0;
+
+    if (len < 2)
+        return -1;
+
+    uint8_t mask = data[pos++];
+    if (mask & 0x80)
+        return -1;
+
+    for (uint8_t i = 0; i < SWF_CON_LEN; i++)
+    {
+        if (mask & (1u << i))
+        {
+            if (pos >= len)
+                return -1;
+            state[i] = data[pos++];
+        }
+    }
+
+    uint32_t val = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (pos >= len)
+            return -1;
+        uint8_t b = data[pos++];
+        val |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *run = val;
+            return pos;
+        }
+    }
+
+    // Varint longer than 5 bytes
+    return -1;
+}
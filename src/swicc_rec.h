@@ -0,0 +1,56 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_REC_H_
+#define SWICC_REC_H_
+
+/* Compact recording format.
+ *  Each record is one run of identical controller states:
+ *    [change mask] [changed state bytes...] [run length varint]
+ *  Bit n of the mask is set when byte n of the 7-byte wire state (see
+ *  swicc_frame.h) differs from the previous record, and only those bytes
+ *  follow.  The run length is an unsigned LEB128 varint (7 bits per byte,
+ *  low bits first, high bit set on all but the last byte).  A run of steady
+ *  input therefore costs 2 bytes instead of 9.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "swicc_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest possible record: mask, every state byte, and a 5-byte varint
+#define REC_MAX_RECORD (1 + SWF_CON_LEN + 5)
+
+size_t rec_encode(const uint8_t *prev, const uint8_t *state, uint32_t run, uint8_t *out);
+int rec_decode(const uint8_t *data, size_t len, uint8_t *state, uint32_t *run);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_REC_H_ */
@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "swicc_sched.h"
+#include "swicc_core.h"
+#include "swicc_movie.h"
+#include "swicc_macro.h"
+#include "swicc_hal.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+// Waiting states, soonest first.  Added by the command parser and taken by
+// the frame update, both with interrupts held off.
+sched_entry_t sched_buff[SCHED_LEN];
+unsigned int sched_count = 0;
+
+//--------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------
+
+/* Frames from b to a; negative if a comes first.  Stays correct when the
+ *  frame counter wraps.
+ */
+static int32_t frame_diff(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b);
+}
+
+/* Schedule a controller state for a player at an absolute frame.
+ *  States for the same frame are applied in the order they were added.
+ */
+uint8_t sched_add(uint32_t frame, player_t *p, const USB_ControllerReport_Input_t *con)
+{
+    uint8_t result = SCHED_OK;
+    uint32_t irq_state = hal_irq_save();
+
+    if (frame_diff(frame, frame_seq) < 0)
+        result = SCHED_LATE;
+    else if (sched_count == SCHED_LEN)
+        result = SCHED_FULL;
+    else
+    {
+        // Insert after everything due at or before this frame
+        unsigned int pos = sched_count;
+        while (pos > 0 && frame_diff(sched_buff[pos - 1].frame, frame) > 0)
+        {
+            sched_buff[pos] = sched_buff[pos - 1];
+            pos--;
+        }
+        sched_buff[pos].frame = frame;
+        sched_buff[pos].player = player_index(p);
+        memcpy(&sched_buff[pos].con, con, sizeof(USB_ControllerReport_Input_t));
+        sched_count++;
+    }
+
+    hal_irq_restore(irq_state);
+    return result;
+}
+
+/* Drop every waiting state.
+ */
+void sched_clear()
+{
+    uint32_t irq_state = hal_irq_save();
+    sched_count = 0;
+    hal_irq_restore(irq_state);
+}
+
+/* Number of states waiting.
+ */
+unsigned int sched_pending()
+{
+    return sched_count;
+}
+
+/* Apply the states due at a frame.
+ *  Called from the frame update, before the players advance, so a state
+ *  takes effect on exactly its frame.  Like IMM, it puts the player in
+ *  real-time mode, stopping a movie or macro and dropping queued states
+ *  the way their own stop commands do.
+ */
+void sched_run(uint32_t frame)
+{
+    unsigned int done = 0;
+
+    while (done < sched_count && frame_diff(sched_buff[done].frame, frame) <= 0)
+    {
+        player_t *p = &players[sched_buff[done].player];
+
+        // Interrupts are already held off here
+        if (p->action_mode == A_MOVIE)
+            movie_halt();
+        else if (p->action_mode == A_MACRO)
+            macro_halt(p);
+
+        memcpy(&p->current_con, &sched_buff[done].con, sizeof(USB_ControllerReport_Input_t));
+        p->action_mode = A_RT;
+        queue_drain(p);
+        done++;
+    }
+
+    if (done > 0)
+    {
+        sched_count -= done;
+        memmove(sched_buff, sched_buff + done, sched_count * sizeof(sched_entry_t));
+    }
+}
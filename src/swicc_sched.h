@@ -0,0 +1,68 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_SCHED_H_
+#define SWICC_SCHED_H_
+
+/* Frame-scheduled controller states.
+ *  The host can load states tagged with an absolute frame number (frame_seq
+ *  at the start of that frame's update) well ahead of time.  Each is applied,
+ *  as an immediate state for its player, by the frame update that produces
+ *  that frame.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "swicc_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most states waiting at once
+#define SCHED_LEN 64
+
+// Results of sched_add
+enum {
+    SCHED_OK,
+    SCHED_LATE, // the frame has already been produced
+    SCHED_FULL  // no room for another state
+};
+
+typedef struct {
+    uint32_t frame;
+    uint8_t player;
+    USB_ControllerReport_Input_t con;
+} sched_entry_t;
+
+uint8_t sched_add(uint32_t frame, player_t *p, const USB_ControllerReport_Input_t *con);
+void sched_clear();
+unsigned int sched_pending();
+void sched_run(uint32_t frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_SCHED_H_ */
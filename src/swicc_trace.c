@@ -0,0 +1,197 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "swicc_trace.h"
+#include "swicc_core.h"
+#include "swicc_frame.h"
+#include "swicc_hal.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+trace_entry_t trace_buff[TRACE_LEN];
+unsigned int trace_head = 0; // next entry to write
+unsigned int trace_used = 0;
+bool trace_on = false;
+
+// Events waiting for the next frame update
+uint32_t trace_edge_us = 0, trace_target_us = 0;
+
+// Dump in progress
+bool trace_dumping = false;
+bool trace_dump_binary;
+unsigned int trace_dump_pos, trace_dump_left;
+
+//--------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------
+
+/* Clear the trace and start recording.
+ */
+void trace_start()
+{
+    uint32_t irq_state = hal_irq_save();
+    trace_head = 0;
+    trace_used = 0;
+    trace_edge_us = 0;
+    trace_target_us = 0;
+    trace_dumping = false;
+    trace_on = true;
+    hal_irq_restore(irq_state);
+}
+
+void trace_stop()
+{
+    trace_on = false;
+}
+
+/* Note a VSYNC edge.  Called from the edge interrupt.
+ */
+void trace_edge(uint64_t t_us)
+{
+    if (trace_on)
+        trace_edge_us = t_us;
+}
+
+/* Note when the running frame interrupt was scheduled for.
+ *  Called from the frame interrupt, before frame_update.
+ */
+void trace_target(uint64_t t_us)
+{
+    if (trace_on)
+        trace_target_us = t_us;
+}
+
+/* Add an entry for the frame update that started at t_us.
+ *  Called at the end of frame_update, before frame_seq moves on, so the entry
+ *  has the frame's number as GFC and AT count it.
+ */
+void trace_frame(uint64_t t_us)
+{
+    if (!trace_on)
+        return;
+
+    trace_entry_t *e = &trace_buff[trace_head];
+    e->frame = frame_seq;
+    e->edge_us = trace_edge_us;
+    e->target_us = trace_target_us;
+    e->update_us = t_us;
+    e->hid_us = 0;
+    e->queue_fill = get_queue_fill(&players[0]);
+    e->mode = players[0].action_mode;
+
+    trace_edge_us = 0;
+    trace_target_us = 0;
+    trace_head = (trace_head + 1) & TRACE_MASK;
+    if (trace_used < TRACE_LEN)
+        trace_used++;
+}
+
+/* Note that the first report for a frame was queued to USB.
+ */
+void trace_hid(uint32_t frame, uint64_t t_us)
+{
+    if (!trace_on || trace_used == 0)
+        return;
+
+    uint32_t irq_state = hal_irq_save();
+    trace_entry_t *e = &trace_buff[(trace_head - 1) & TRACE_MASK];
+    if (e->frame == frame)
+        e->hid_us = t_us;
+    hal_irq_restore(irq_state);
+}
+
+/* Start sending the trace, oldest entry first.  Tracing stops so the
+ *  entries don't change underneath the dump.
+ */
+void trace_dump_start(bool binary)
+{
+    trace_on = false;
+    trace_dump_pos = (trace_head - trace_used) & TRACE_MASK;
+    trace_dump_left = trace_used;
+    trace_dump_binary = binary;
+    trace_dumping = true;
+}
+
+/* Send dump output as transmit space allows.  Called from the main loop.
+ *  Text dumps send one "+T" line per entry; binary dumps send BOP_TRACE
+ *  frames of up to TRACE_PER_FRAME entries.  Both end with an empty reply.
+ */
+void trace_task()
+{
+    uint8_t payload[TRACE_PER_FRAME * TRACE_WIRE_LEN];
+    uint8_t enc[SWF_MAX_ENCODED];
+    char msgstr[64];
+    size_t len;
+
+    while (trace_dumping)
+    {
+        unsigned int n = trace_dump_left < TRACE_PER_FRAME ? trace_dump_left : TRACE_PER_FRAME;
+
+        if (trace_dump_binary)
+        {
+            for (unsigned int i = 0; i < n; i++)
+            {
+                const trace_entry_t *e = &trace_buff[(trace_dump_pos + i) & TRACE_MASK];
+                uint8_t *p = payload + i * TRACE_WIRE_LEN;
+                put_be32(p, e->frame);
+                put_be32(p + 4, e->edge_us);
+                put_be32(p + 8, e->target_us);
+                put_be32(p + 12, e->update_us);
+                put_be32(p + 16, e->hid_us);
+                put_be16(p + 20, e->queue_fill);
+                p[22] = e->mode;
+            }
+            len = swf_encode(BOP_TRACE | BOP_REPLY, payload, n * TRACE_WIRE_LEN, enc);
+        }
+        else if (n > 0)
+        {
+            const trace_entry_t *e = &trace_buff[trace_dump_pos];
+            n = 1;
+            len = sprintf(msgstr, "+T %08X %08X %08X %08X %08X %04X %u\r\n",
+                          (unsigned int)e->frame, (unsigned int)e->edge_us,
+                          (unsigned int)e->target_us, (unsigned int)e->update_us,
+                          (unsigned int)e->hid_us, e->queue_fill, e->mode);
+            memcpy(enc, msgstr, len);
+        }
+        else
+        {
+            len = sprintf(msgstr, "+TRD 0\r\n");
+            memcpy(enc, msgstr, len);
+        }
+
+        // Try again once the transmit buffer drains
+        if (!hal_uart_try_write(enc, len))
+            return;
+
+        if (n == 0)
+            trace_dumping = false;
+        trace_dump_pos = (trace_dump_pos + n) & TRACE_MASK;
+        trace_dump_left -= n;
+    }
+}
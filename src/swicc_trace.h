@@ -0,0 +1,73 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_TRACE_H_
+#define SWICC_TRACE_H_
+
+/* Per-frame timing trace.
+ *  While tracing, every frame update adds one entry to a ring holding the
+ *  last TRACE_LEN frames.  Times are the low 32 bits of the microsecond
+ *  clock, or 0 if the event did not happen for that frame.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_LEN 512 // must be a power of two
+#define TRACE_MASK (TRACE_LEN - 1)
+
+// Size of an entry in the binary export, and entries per export frame
+#define TRACE_WIRE_LEN 23
+#define TRACE_PER_FRAME 10
+
+typedef struct {
+    uint32_t frame;      // frame number (frame_seq during its update)
+    uint32_t edge_us;    // VSYNC edge that led to this frame
+    uint32_t target_us;  // time the frame interrupt was scheduled for
+    uint32_t update_us;  // time the frame update actually ran
+    uint32_t hid_us;     // time the frame's first report was queued to USB
+    uint16_t queue_fill; // player 0's playback queue fill after the update
+    uint8_t mode;        // player 0's action mode
+} trace_entry_t;
+
+extern bool trace_on;
+
+void trace_start();
+void trace_stop();
+void trace_edge(uint64_t t_us);
+void trace_target(uint64_t t_us);
+void trace_frame(uint64_t t_us);
+void trace_hid(uint32_t frame, uint64_t t_us);
+void trace_dump_start(bool binary);
+void trace_task();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_TRACE_H_ */
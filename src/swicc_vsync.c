@@ -0,0 +1,265 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swicc_vsync.h"
+#include "swicc_core.h"
+#include "swicc_hal.h"
+
+//--------------------------------------------------------------------
+// Global variables
+//--------------------------------------------------------------------
+
+// Loop state, owned by the VSYNC and frame interrupts
+uint64_t vpll_next;        // predicted time of the next edge
+uint32_t vpll_period;      // estimated period
+int32_t vpll_error_us = 0; // phase error of the last accepted edge, in us
+uint32_t vpll_jitter;      // average absolute phase error
+bool vpll_acquired;        // vpll_next is based on a real edge
+bool vpll_locked;
+bool vpll_edge_seen;       // an edge was accepted since the last frame
+uint8_t vpll_good, vpll_bad;
+uint32_t vpll_flywheel_count; // frames run without an edge
+uint32_t vpll_reject_count;   // edges treated as noise
+
+// Delay auto-scan.  Host polls are binned by their phase within the period.
+uint16_t vpll_scan_bins[VPLL_SCAN_BINS];
+volatile uint16_t vpll_scan_frames = 0; // frames left to observe
+bool vpll_scanning = false;
+
+//--------------------------------------------------------------------
+// Functions
+//--------------------------------------------------------------------
+
+/* Forget the tracked signal.  Called when VSYNC is enabled.
+ */
+void vpll_reset()
+{
+    uint32_t irq_state = hal_irq_save();
+    vpll_period = VPLL_NOMINAL_US << VPLL_FRAC;
+    vpll_jitter = 0;
+    vpll_error_us = 0;
+    vpll_acquired = false;
+    vpll_locked = false;
+    vpll_edge_seen = false;
+    vpll_good = 0;
+    vpll_bad = 0;
+    vpll_flywheel_count = 0;
+    vpll_reject_count = 0;
+    hal_irq_restore(irq_state);
+}
+
+/* Time of the frame update that follows an edge at edge (1/16 us), in us.
+ *  The delay is capped so the update always comes before the next edge's
+ *  window opens.
+ */
+static uint64_t vpll_frame_time(uint64_t edge)
+{
+    uint32_t max_delay = (vpll_period >> VPLL_FRAC) - VPLL_WINDOW_US - 100;
+    uint32_t delay = frame_delay_us < max_delay ? frame_delay_us : max_delay;
+
+    return (edge >> VPLL_FRAC) + delay;
+}
+
+/* Start tracking from an edge, discarding the old prediction.
+ */
+static uint64_t vpll_acquire(uint64_t t)
+{
+    vpll_next = t;
+    vpll_acquired = true;
+    vpll_locked = false;
+    vpll_edge_seen = true;
+    vpll_good = 0;
+    vpll_bad = 0;
+
+    return vpll_frame_time(vpll_next);
+}
+
+/* Handle a VSYNC edge at t_us.  Called from the edge interrupt.
+ *  Returns the time (in us) the frame update should now be scheduled for,
+ *  or 0 to leave the schedule alone.
+ */
+uint64_t vpll_edge(uint64_t t_us)
+{
+    uint64_t t = t_us << VPLL_FRAC;
+
+    if (!vpll_acquired)
+        return vpll_acquire(t);
+
+    int64_t diff = (int64_t)(t - vpll_next);
+    if (diff > INT32_MAX / 2 || diff < -INT32_MAX / 2)
+        return vpll_acquire(t);
+    int32_t err = (int32_t)diff;
+    // An edge closer to the previous prediction is late, and its frame has
+    // already run from the flywheel
+    bool late = err < -(int32_t)(vpll_period / 2);
+    if (late)
+        err += vpll_period;
+
+    // Once locked, only edges near the prediction count, and only one per frame
+    uint32_t abs_err = abs(err);
+    uint32_t window = vpll_locked ? VPLL_LOCKED_WINDOW_US : VPLL_WINDOW_US;
+    if (abs_err > (window << VPLL_FRAC) || (vpll_locked && vpll_edge_seen && !late))
+    {
+        vpll_reject_count++;
+        if (!vpll_locked || ++vpll_bad >= VPLL_UNLOCK_EDGES)
+            return vpll_acquire(t);
+        return 0;
+    }
+    vpll_bad = 0;
+
+    // Proportional-integral loop filter: pull the phase halfway to the edge
+    // and nudge the period
+    vpll_next += err / 2;
+    vpll_period += err / 16;
+    if (vpll_period > ((VPLL_NOMINAL_US + VPLL_NOMINAL_US / 32) << VPLL_FRAC))
+        vpll_period = (VPLL_NOMINAL_US + VPLL_NOMINAL_US / 32) << VPLL_FRAC;
+    if (vpll_period < ((VPLL_NOMINAL_US - VPLL_NOMINAL_US / 32) << VPLL_FRAC))
+        vpll_period = (VPLL_NOMINAL_US - VPLL_NOMINAL_US / 32) << VPLL_FRAC;
+
+    vpll_jitter += ((int32_t)abs_err - (int32_t)vpll_jitter) / 16;
+    vpll_error_us = err >> VPLL_FRAC;
+
+    if (abs_err < (VPLL_LOCK_US << VPLL_FRAC))
+    {
+        if (vpll_good < VPLL_LOCK_EDGES)
+            vpll_good++;
+        else
+            vpll_locked = true;
+    }
+    else
+        vpll_good = 0;
+
+    if (late)
+        return 0;
+
+    vpll_edge_seen = true;
+    return vpll_frame_time(vpll_next);
+}
+
+/* Move on to the next predicted edge.  Called from the frame interrupt.
+ *  Returns the time (in us) of the following frame update, which an edge
+ *  may later move, or 0 if no edge has been seen yet.
+ */
+uint64_t vpll_frame()
+{
+    // Nothing to run from until the first edge
+    if (!vpll_acquired)
+        return 0;
+
+    if (!vpll_edge_seen)
+    {
+        vpll_flywheel_count++;
+        if (++vpll_bad >= VPLL_UNLOCK_EDGES)
+            vpll_locked = false;
+    }
+    vpll_edge_seen = false;
+
+    if (vpll_scan_frames > 0)
+        vpll_scan_frames--;
+
+    vpll_next += vpll_period;
+    return vpll_frame_time(vpll_next);
+}
+
+/* Note a host poll (the console collecting a report) at t_us.
+ *  Only used while scanning for a frame delay.
+ */
+void vpll_poll(uint64_t t_us)
+{
+    if (!vpll_scanning || vpll_scan_frames == 0)
+        return;
+
+    uint32_t irq_state = hal_irq_save();
+    int64_t phase = (int64_t)((t_us << VPLL_FRAC) - vpll_next) % (int64_t)vpll_period;
+    if (phase < 0)
+        phase += vpll_period;
+    vpll_scan_bins[(phase * VPLL_SCAN_BINS) / vpll_period]++;
+    hal_irq_restore(irq_state);
+}
+
+/* Start looking for the best frame delay.
+ *  Needs a locked loop.  The result is reported by vpll_task.
+ */
+bool vpll_scan_start()
+{
+    if (!vsync_en || !vpll_locked)
+        return false;
+
+    memset(vpll_scan_bins, 0, sizeof(vpll_scan_bins));
+    vpll_scanning = true;
+    vpll_scan_frames = VPLL_SCAN_FRAMES;
+
+    return true;
+}
+
+/* Finish a delay scan.  Called from the main loop.
+ *  The host's polls cluster at certain phases of the frame; an update made
+ *  just before one of them may or may not be collected by it.  The new delay
+ *  is the middle of the widest stretch of the period with no polls, which
+ *  keeps the update as far as possible from that race.
+ */
+void vpll_task()
+{
+    char msgstr[20];
+
+    if (!vpll_scanning || vpll_scan_frames > 0)
+        return;
+    vpll_scanning = false;
+
+    // Longest run of empty bins, wrapping around the end of the period
+    int best_start = 0, best_len = 0, run_start = 0, run_len = 0;
+    for (int i = 0; i < 2 * VPLL_SCAN_BINS; i++)
+    {
+        if (vpll_scan_bins[i % VPLL_SCAN_BINS] == 0)
+        {
+            if (run_len++ == 0)
+                run_start = i;
+            if (run_len > best_len && run_len <= VPLL_SCAN_BINS)
+            {
+                best_start = run_start;
+                best_len = run_len;
+            }
+        }
+        else
+            run_len = 0;
+    }
+
+    // Polls everywhere (or nowhere): there is no better delay to pick
+    if (best_len < 2 || best_len == VPLL_SCAN_BINS)
+    {
+        hal_uart_puts("+VSA ERR\r\n");
+        return;
+    }
+
+    uint32_t period_us = vpll_period >> VPLL_FRAC;
+    uint32_t center = (2 * best_start + best_len) % (2 * VPLL_SCAN_BINS);
+    frame_delay_us = (center * period_us) / (2 * VPLL_SCAN_BINS);
+
+    sprintf(msgstr, "+VSA %04X\r\n", frame_delay_us);
+    hal_uart_puts(msgstr);
+}
@@ -0,0 +1,79 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_VSYNC_H_
+#define SWICC_VSYNC_H_
+
+/* VSYNC tracking.
+ *  A phase-locked loop predicts each VSYNC edge from the ones before it.
+ *  Edges close to the prediction steer the phase and period estimates;
+ *  edges far from it are treated as noise, and frames carry on from the
+ *  prediction (flywheel) when an edge is missing.  Frame updates are
+ *  scheduled frame_delay_us after each predicted edge.
+ *
+ *  Times are in 1/16 us (VPLL_FRAC fraction bits) unless noted.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VPLL_FRAC 4
+#define VPLL_NOMINAL_US 16667
+// Edges further than this from the prediction are rejected (or, before
+// lock, restart tracking); the window narrows once locked
+#define VPLL_WINDOW_US 1500
+#define VPLL_LOCKED_WINDOW_US 500
+// Lock after this many edges in a row within VPLL_LOCK_US of the prediction
+#define VPLL_LOCK_US 250
+#define VPLL_LOCK_EDGES 16
+// Lose lock after this many missing or rejected edges in a row
+#define VPLL_UNLOCK_EDGES 8
+
+// Delay auto-scan: frames to observe, and phase bins across one period
+#define VPLL_SCAN_FRAMES 240
+#define VPLL_SCAN_BINS 64
+
+extern uint32_t vpll_period;
+extern int32_t vpll_error_us;
+extern uint32_t vpll_jitter;
+extern bool vpll_locked;
+extern uint32_t vpll_flywheel_count;
+extern uint32_t vpll_reject_count;
+
+void vpll_reset();
+uint64_t vpll_edge(uint64_t t_us);
+uint64_t vpll_frame();
+void vpll_poll(uint64_t t_us);
+bool vpll_scan_start();
+void vpll_task();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_VSYNC_H_ */
@@ -81,7 +81,12 @@ extern "C" {
 #endif
 
 //------------- CLASS -------------//
+// One HID interface per controller
+#ifdef SWICC_PLAYERS
+#define CFG_TUD_HID             SWICC_PLAYERS
+#else
 #define CFG_TUD_HID             1
+#endif
 #define CFG_TUD_CDC             0
 #define CFG_TUD_MSC             0
 #define CFG_TUD_MIDI            0
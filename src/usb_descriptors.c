@@ -78,24 +78,38 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
+// One HID interface per controller (CFG_TUD_HID, see tusb_config.h)
 enum {
     ITF_NUM_HID,
-    ITF_NUM_TOTAL
+    ITF_NUM_TOTAL = ITF_NUM_HID + CFG_TUD_HID
 };
 
-#define  CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_HID_INOUT_DESC_LEN)
+#define  CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_INOUT_DESC_LEN)
 
+// Endpoints for the first controller; each further one uses the next numbers
 #define EPNUM_HID_IN   0x81
 #define EPNUM_HID_OUT  0x02
 
+// Interface number, string index, protocol, report descriptor len, EP In & Out address, size & polling interval
+#define HID_INTERFACE_DESC(n) \
+    TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_HID + (n), 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), \
+            EPNUM_HID_OUT + (n), EPNUM_HID_IN + (n), 64, HID_POLL_MS)
+
 uint8_t const desc_configuration[] =
 {
     // Config number, interface count, string index, total length, attribute, power in mA
     TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0x80, 500),
 
-    // Interface number, string index, protocol, report descriptor len, EP In & Out address, size & polling interval
-    TUD_HID_INOUT_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report),
-            EPNUM_HID_OUT, EPNUM_HID_IN, 64, 8)
+    HID_INTERFACE_DESC(0),
+#if CFG_TUD_HID > 1
+    HID_INTERFACE_DESC(1),
+#endif
+#if CFG_TUD_HID > 2
+    HID_INTERFACE_DESC(2),
+#endif
+#if CFG_TUD_HID > 3
+    HID_INTERFACE_DESC(3),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -23,6 +23,13 @@
 #ifndef USB_DESCRIPTORS_H_
 #define USB_DESCRIPTORS_H_
 
+// HID polling interval in ms.  Low-latency builds poll every 1 ms.
+#ifdef SWICC_LOW_LATENCY_HID
+#define HID_POLL_MS 1
+#else
+#define HID_POLL_MS 8
+#endif
+
 #define TUD_HID_REPORT_DESC_USBCON(...) \
   HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP     )        ,\
   HID_USAGE      ( HID_USAGE_DESKTOP_GAMEPAD  )        ,\
@@ -0,0 +1,140 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Cost of text command dispatch on the host.  process_command finds the
+ *  handler with a binary search over its sorted table; for comparison, the
+ *  same names are also matched with a strncmp chain that runs every check,
+ *  as the parser did before the table.  The chain times the matching only,
+ *  while process_command includes running the handler.  The chain is checked
+ *  against the table before timing, so the two stay like for like.  Not run
+ *  by ctest; build bench_dispatch and run it by hand.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "swicc_core.h"
+
+#define ROUNDS 1000000
+
+// Every command name with its space, in the order the old chain tested them
+static const char *chain[] = {
+    "ID ", "VER ", "Q ", "QB ", "QL ", "SLAG ", "IMM ", "VSD ", "REC ", "GCS ",
+    "GOV ", "GQF ", "QWM ", "GQR ", "GRF ", "GRR ", "GRB ", "GR ", "VSYNC ", "MVB ",
+    "MVW ", "MVC ", "MVP ", "GMV ", "VSA ", "GVP ", "GVE ", "GVL ", "TRC ", "TRD ",
+    "GLAT ", "BAUD ", "BIN ", "LED ", "SLAGU ", "GFC ", "AT ", "ATC ", "P ", "MDEF ",
+    "MADD ", "MDEL ", "ML ", "MRUN ",
+};
+
+static size_t chain_len[sizeof(chain) / sizeof(chain[0])];
+
+// Commands timed, chosen to reply little and change nothing that matters
+static const char *lines[] = {"ID ", "GQF ", "GFC ", "LED 1", "VSD 0", "XYZ "};
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Check that the chain holds exactly the names in the dispatch table
+static bool chain_matches_table(void)
+{
+    unsigned int count = 0;
+    bool ok = true;
+
+    for (const char *name; (name = command_name(count)) != NULL; count++)
+    {
+        bool found = false;
+        for (unsigned int i = 0; i < sizeof(chain) / sizeof(chain[0]); i++)
+        {
+            if (chain_len[i] == strlen(name) + 1 && strncmp(chain[i], name, chain_len[i] - 1) == 0)
+                found = true;
+        }
+        if (!found)
+        {
+            printf("%s is in the table but not the chain\n", name);
+            ok = false;
+        }
+    }
+    if (count != sizeof(chain) / sizeof(chain[0]))
+    {
+        printf("the table has %u names and the chain %u\n", count, (unsigned int)(sizeof(chain) / sizeof(chain[0])));
+        ok = false;
+    }
+    return ok;
+}
+
+// Match a line against every name in turn, without stopping at a match
+static int chain_match(const char *cmd_str)
+{
+    int found = -1;
+    for (unsigned int i = 0; i < sizeof(chain) / sizeof(chain[0]); i++)
+    {
+        if (strncmp(cmd_str, chain[i], chain_len[i]) == 0)
+            found = i;
+    }
+    return found;
+}
+
+int main(void)
+{
+    char cmd[CMD_STR_LEN];
+    volatile int sink = 0;
+
+    buffer_init();
+    for (unsigned int i = 0; i < sizeof(chain) / sizeof(chain[0]); i++)
+        chain_len[i] = strlen(chain[i]);
+    if (!chain_matches_table())
+        return 1;
+
+    printf("%-8s %16s %16s\n", "command", "process_command", "strncmp chain");
+    for (unsigned int n = 0; n < sizeof(lines) / sizeof(lines[0]); n++)
+    {
+        double start = now_s();
+        for (unsigned long i = 0; i < ROUNDS; i++)
+        {
+            strcpy(cmd, lines[n]);
+            process_command(cmd);
+            test_out_clear();
+        }
+        double table_s = now_s() - start;
+
+        start = now_s();
+        for (unsigned long i = 0; i < ROUNDS; i++)
+        {
+            strcpy(cmd, lines[n]);
+            sink += chain_match(cmd);
+            test_out_clear();
+        }
+        double chain_s = now_s() - start;
+
+        printf("%-8s %13.1f ns %13.1f ns\n", lines[n], table_s * 1e9 / ROUNDS, chain_s * 1e9 / ROUNDS);
+    }
+
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Cost of the binary framing on the host, and its size on the wire against
+ *  the text commands it replaces.  Not run by ctest; build bench_frame and
+ *  run it by hand.  Host numbers are only a guide to the RP2040.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "swicc_core.h"
+#include "swicc_frame.h"
+
+#define ROUNDS 200000
+
+// Most states one QUEUE_BATCH frame carries
+#define BATCH_STATES (SWF_MAX_PAYLOAD / SWF_CON_LEN)
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, double secs, unsigned long count)
+{
+    printf("%-28s %8.1f ns each, %10.0f per second\n", what, secs * 1e9 / count, count / secs);
+}
+
+static void wire(const char *what, size_t bytes, unsigned int states)
+{
+    printf("%-28s %4u bytes, %5.1f per state\n", what, (unsigned int)bytes, (double)bytes / states);
+}
+
+int main(void)
+{
+    static uint8_t payload[BATCH_STATES * SWF_CON_LEN];
+    static uint8_t stream[ROUNDS / 100 * 2 * SWF_MAX_ENCODED];
+    uint8_t enc[SWF_MAX_ENCODED];
+    swf_decoder_t dec;
+    volatile size_t sink = 0;
+    double start;
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = rand() & 0xFF;
+
+    // Bytes on the wire for one state and for a full line or frame of them.
+    // Text lines end in CR LF, as a host on a terminal would send them.
+    wire("Q (text)", strlen("+Q 00000880808080\r\n"), 1);
+    wire("QB (text)", 4 + 14 * QB_MAX_FRAMES + 2, QB_MAX_FRAMES);
+    wire("QUEUE frame", swf_encode(BOP_QUEUE, payload, SWF_CON_LEN, enc), 1);
+    wire("QUEUE_BATCH frame", swf_encode(BOP_QUEUE_BATCH, payload, sizeof(payload), enc), BATCH_STATES);
+    printf("\n");
+
+    start = now_s();
+    for (unsigned long i = 0; i < ROUNDS; i++)
+        sink += swf_encode(BOP_QUEUE, payload, SWF_CON_LEN, enc);
+    report("swf_encode, one state", now_s() - start, ROUNDS);
+
+    start = now_s();
+    for (unsigned long i = 0; i < ROUNDS / 10; i++)
+        sink += swf_encode(BOP_QUEUE_BATCH, payload, sizeof(payload), enc);
+    report("swf_encode, full batch", now_s() - start, ROUNDS / 10);
+
+    // Decoding a stream of single and batch frames, per byte received
+    size_t stream_len = 0;
+    for (unsigned long i = 0; i < ROUNDS / 100; i++)
+    {
+        stream_len += swf_encode(BOP_QUEUE, payload, SWF_CON_LEN, stream + stream_len);
+        stream_len += swf_encode(BOP_QUEUE_BATCH, payload, sizeof(payload), stream + stream_len);
+    }
+    unsigned long frames = 0, errors = 0;
+    swf_decoder_reset(&dec);
+    start = now_s();
+    for (int pass = 0; pass < 10; pass++)
+    {
+        for (size_t i = 0; i < stream_len; i++)
+        {
+            int result = swf_decode_byte(&dec, stream[i]);
+            if (result > 0)
+                frames++;
+            else if (result == SWF_ERROR)
+                errors++;
+        }
+    }
+    report("swf_decode_byte, per byte", now_s() - start, 10UL * stream_len);
+
+    if (errors != 0 || frames != 10UL * 2 * (ROUNDS / 100))
+    {
+        printf("decoded %lu frames with %lu errors\n", frames, errors);
+        return 1;
+    }
+    (void)sink;
+    return 0;
+}
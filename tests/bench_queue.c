@@ -0,0 +1,102 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Throughput of the controller queue path on the host: hex decoding, QB
+ *  batches and playback.  Not run by ctest; build bench_queue and run it by
+ *  hand to compare changes.  Host numbers are only a guide to the RP2040.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "swicc_core.h"
+
+#define ROUNDS 200000
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, double secs, unsigned long count)
+{
+    printf("%-28s %8.1f ns each, %10.0f per second\n", what, secs * 1e9 / count, count / secs);
+}
+
+int main(void)
+{
+    player_t *p = &players[0];
+    USB_ControllerReport_Input_t cons[QB_MAX_FRAMES];
+    volatile uint16_t sink = 0;
+    char line[CMD_STR_LEN];
+    double start;
+
+    buffer_init();
+
+    // Decoding alone, mixed case
+    static const char *states[] = {"A5C30712345678", "a5c30712345678", "00000880808080", "ffff0f00ff00ff"};
+    start = now_s();
+    for (unsigned long i = 0; i < 4UL * ROUNDS; i++)
+    {
+        parse_con_state(states[i & 3], &cons[0]);
+        sink += cons[0].Button;
+    }
+    report("parse_con_state", now_s() - start, 4UL * ROUNDS);
+
+    // Decoded batches in and out of the ring
+    for (int i = 0; i < QB_MAX_FRAMES; i++)
+    {
+        cons[i] = neutral_con;
+        cons[i].Button = i;
+    }
+    start = now_s();
+    for (unsigned long i = 0; i < ROUNDS / 10; i++)
+    {
+        queue_con_batch(p, cons, QB_MAX_FRAMES);
+        for (int f = 0; f < QB_MAX_FRAMES; f++)
+            frame_update();
+        sink += p->current_con.Button;
+    }
+    report("queue_con_batch + playback", now_s() - start, (unsigned long)(ROUNDS / 10) * QB_MAX_FRAMES);
+
+    // The whole QB command, from text to the ring
+    strcpy(line, "+QB ");
+    for (int i = 0; i < QB_MAX_FRAMES; i++)
+        strcat(line, states[i & 3]);
+    strcat(line, "\n");
+    start = now_s();
+    for (unsigned long i = 0; i < ROUNDS / 10; i++)
+    {
+        test_out_clear();
+        test_send(line);
+        queue_clear(p);
+    }
+    report("QB command, per state", now_s() - start, (unsigned long)(ROUNDS / 10) * QB_MAX_FRAMES);
+
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Core behaviour: queue wrap, lag changes with SLAG, run-length boundaries
+ *  at REC_LINE_MAX and recording wrap.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "swicc_core.h"
+
+#define MAX_LINES 100000
+
+// Recording read back with GR
+static uint16_t gr_button[MAX_LINES];
+static unsigned int gr_run[MAX_LINES];
+static int gr_lines;
+
+static void set_imm(uint16_t button)
+{
+    char cmd[32];
+    sprintf(cmd, "+IMM %04X08\n", button);
+    test_send(cmd);
+}
+
+// Read the whole recording with GR, one line per entry
+static void read_recording(void)
+{
+    gr_lines = 0;
+    test_out_clear();
+    test_send("+GR 0\n");
+    while (true)
+    {
+        char *line = test_out;
+        int sent = 0;
+        while ((line = strstr(line, "+R ")) != NULL)
+        {
+            sent++;
+            unsigned int b, run;
+            if (gr_lines < MAX_LINES && sscanf(line, "+R %4x%*10xx%2x", &b, &run) == 2)
+            {
+                gr_button[gr_lines] = b;
+                gr_run[gr_lines] = run;
+                gr_lines++;
+            }
+            line += 3;
+        }
+        // Each GR sends at most 30 lines
+        CHECK(sent <= 30);
+        if (strstr(test_out, "+GR 0\r\n"))
+            break;
+        CHECK(strstr(test_out, "+GR 1\r\n") != NULL);
+        test_out_clear();
+        test_send("+GR 1\n");
+    }
+}
+
+static void test_queue_wrap(void)
+{
+    char cmd[32];
+    player_t *p = &players[0];
+
+    buffer_init();
+    test_out_clear();
+
+    // Keep the queue partly full over several trips round the ring
+    uint16_t next_in = 1, next_out = 1;
+    for (int round = 0; round < 10 * CON_BUFF_LEN / 50; round++)
+    {
+        for (int i = 0; i < 50; i++)
+        {
+            sprintf(cmd, "+Q %04X08\n", next_in++);
+            test_send(cmd);
+        }
+        for (int i = 0; i < 50; i++)
+        {
+            frame_update();
+            CHECK(p->current_con.Button == next_out);
+            next_out++;
+        }
+        CHECK(get_queue_fill(p) == 0);
+    }
+    CHECK(strstr(test_out, "QFULL") == NULL);
+
+    // Once drained, the last state keeps playing
+    frame_update();
+    CHECK(p->current_con.Button == (uint16_t)(next_out - 1));
+
+    // The ring holds one less than its length; the rest are refused
+    for (int i = 0; i < CON_BUFF_LEN; i++)
+    {
+        sprintf(cmd, "+Q %04X08\n", i);
+        test_send(cmd);
+    }
+    CHECK(get_queue_fill(p) == CON_BUFF_LEN - 1);
+    CHECK(p->queue_rejected == 1);
+    CHECK(strstr(test_out, "+QFULL 0001\r\n") != NULL);
+    for (int i = 0; i < CON_BUFF_LEN - 1; i++)
+    {
+        frame_update();
+        CHECK(p->current_con.Button == i);
+    }
+    CHECK(get_queue_fill(p) == 0);
+}
+
+static void test_slag(void)
+{
+    player_t *p = &players[0];
+
+    buffer_init();
+    test_time_us = 1000000;
+    test_send("+SLAG 2\n");
+    CHECK(p->lag_us == 2 * 16667);
+
+    test_send("+QL 000108\n");
+    CHECK(p->action_mode == A_LAG);
+
+    // Not out until two frames' worth of time has passed
+    test_time_us += 2 * 16667 - 1;
+    frame_update();
+    CHECK(p->current_con.Button == 0);
+    test_time_us += 1;
+    frame_update();
+    CHECK(p->current_con.Button == 1);
+
+    // Raising the lag holds back states already waiting
+    test_send("+QL 000208\n");
+    test_send("+SLAG 10\n");
+    test_time_us += 2 * 16667;
+    frame_update();
+    CHECK(p->current_con.Button == 1);
+
+    // Lowering it lets out what is now due at once
+    test_send("+SLAG 1\n");
+    frame_update();
+    CHECK(p->current_con.Button == 2);
+
+    // No lag at all
+    test_send("+SLAG 0\n+QL 000308\n");
+    frame_update();
+    CHECK(p->current_con.Button == 3);
+
+    // The lag is capped, as is the frame count
+    test_send("+SLAG 999\n");
+    CHECK(p->lag_us == LAG_MAX_US);
+    test_send("+SLAGU 1234\n");
+    CHECK(p->lag_us == 1234);
+
+    test_time_us = 0;
+}
+
+static void test_rle_boundaries(void)
+{
+    static const unsigned int runs[] = {1, REC_LINE_MAX - 1, REC_LINE_MAX, REC_LINE_MAX + 1, 2 * REC_LINE_MAX, 1000};
+    const int count = sizeof(runs) / sizeof(runs[0]);
+
+    buffer_init();
+    test_send("+REC 1\n");
+    for (int i = 0; i < count; i++)
+    {
+        set_imm(i + 1);
+        for (unsigned int f = 0; f < runs[i]; f++)
+            frame_update();
+    }
+    // Close the last run
+    set_imm(0);
+    frame_update();
+    test_send("+REC 0\n");
+
+    read_recording();
+
+    // The neutral frame the recording started with, then each run split into
+    // lines of at most REC_LINE_MAX frames
+    int line = 0;
+    CHECK(gr_lines > 0 && gr_button[0] == 0 && gr_run[0] == 1);
+    line++;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int left = runs[i];
+        while (left > 0)
+        {
+            unsigned int expect = left < REC_LINE_MAX ? left : REC_LINE_MAX;
+            CHECK(line < gr_lines);
+            CHECK(gr_button[line] == i + 1);
+            CHECK(gr_run[line] == expect);
+            left -= expect;
+            line++;
+        }
+    }
+    CHECK(line < gr_lines && gr_button[line] == 0);
+}
+
+static void test_open_run(void)
+{
+    const unsigned int frames = 100 * REC_LINE_MAX + 7;
+
+    // A long run still in progress is sent over several GR calls
+    buffer_init();
+    set_imm(5);
+    test_send("+REC 1\n");
+    for (unsigned int f = 1; f < frames; f++)
+        frame_update();
+
+    read_recording();
+    unsigned int total = 0;
+    for (int i = 0; i < gr_lines; i++)
+    {
+        CHECK(gr_button[i] == 5);
+        total += gr_run[i];
+    }
+    CHECK(total == frames);
+    CHECK(gr_lines == 101);
+    test_send("+REC 0\n");
+}
+
+static void test_recording_wrap(void)
+{
+    player_t *p = &players[0];
+    unsigned int frames = 0;
+
+    buffer_init();
+    test_send("+REC 1\n");
+
+    // A new state every frame until well past the ring's capacity
+    while (!p->recording_wrap || frames < 2 * (REC_BUFF_BYTES / 2))
+    {
+        set_imm(++frames);
+        frame_update();
+    }
+    test_send("+REC 0\n");
+
+    test_out_clear();
+    test_send("+GRR \n");
+    CHECK(strcmp(test_out, "+GRR 00000000\r\n") == 0);
+    test_out_clear();
+    test_send("+GRB \n");
+    CHECK(strtoul(test_out + 5, NULL, 16) == REC_BUFF_BYTES);
+    CHECK(strlen(test_out) == 15);
+
+    // What is left is the most recent stretch, unbroken, up to the last state
+    read_recording();
+    CHECK(gr_lines > 1000);
+    for (int i = 0; i < gr_lines; i++)
+    {
+        CHECK(gr_run[i] == 1);
+        CHECK(gr_button[i] == (uint16_t)(frames - (gr_lines - 1) + i));
+    }
+}
+
+int main(void)
+{
+    test_queue_wrap();
+    test_slag();
+    test_rle_boundaries();
+    test_open_run();
+    test_recording_wrap();
+    return test_result("test_core");
+}
@@ -0,0 +1,121 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Binary framing: CRC-16 check value, COBS round trips and rejected frames.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "swicc_frame.h"
+
+// Feed an encoded frame to a decoder; returns the result at the delimiter
+static int decode_all(swf_decoder_t *dec, const uint8_t *enc, size_t len)
+{
+    int result = SWF_PENDING;
+    for (size_t i = 0; i < len; i++)
+        result = swf_decode_byte(dec, enc[i]);
+    return result;
+}
+
+static void test_crc(void)
+{
+    // The standard check value for CRC-16/CCITT-FALSE
+    CHECK(swf_crc16((const uint8_t *)"123456789", 9) == 0x29B1);
+    CHECK(swf_crc16_update(swf_crc16((const uint8_t *)"1234", 4), (const uint8_t *)"56789", 5) == 0x29B1);
+}
+
+static void test_round_trip(void)
+{
+    uint8_t payload[SWF_MAX_PAYLOAD];
+    uint8_t enc[SWF_MAX_ENCODED];
+    swf_decoder_t dec;
+
+    swf_decoder_reset(&dec);
+    srand(1);
+    for (size_t len = 0; len <= SWF_MAX_PAYLOAD; len++)
+    {
+        // Mix in runs of zeros and of non-zero bytes to reach every COBS case
+        for (size_t i = 0; i < len; i++)
+            payload[i] = (len % 3 == 0) ? 0 : (len % 3 == 1) ? 0xFF : rand() & 0xFF;
+
+        size_t enc_len = swf_encode(BOP_QUEUE, payload, len, enc);
+        CHECK(enc_len > 0 && enc_len <= SWF_MAX_ENCODED);
+        CHECK(memchr(enc, SWF_DELIM, enc_len - 1) == NULL);
+        CHECK(enc[enc_len - 1] == SWF_DELIM);
+
+        int n = decode_all(&dec, enc, enc_len);
+        CHECK(n == (int)len + 1);
+        CHECK(dec.buf[0] == BOP_QUEUE);
+        CHECK(memcmp(dec.buf + 1, payload, len) == 0);
+    }
+
+    CHECK(swf_encode(BOP_QUEUE, payload, SWF_MAX_PAYLOAD + 1, enc) == 0);
+}
+
+static void test_rejects(void)
+{
+    uint8_t payload[SWF_CON_LEN] = {0x00, 0x04, 0x08, 0x80, 0x80, 0x80, 0x80};
+    uint8_t enc[SWF_MAX_ENCODED];
+    swf_decoder_t dec;
+
+    swf_decoder_reset(&dec);
+    size_t enc_len = swf_encode(BOP_IMM, payload, sizeof(payload), enc);
+
+    // Any single flipped bit is caught
+    for (size_t i = 0; i < enc_len - 1; i++)
+    {
+        for (int bit = 0; bit < 8; bit++)
+        {
+            enc[i] ^= 1 << bit;
+            if (enc[i] != SWF_DELIM)
+                CHECK(decode_all(&dec, enc, enc_len) == SWF_ERROR);
+            swf_decoder_reset(&dec);
+            enc[i] ^= 1 << bit;
+        }
+    }
+
+    // Lone delimiters are ignored, and the decoder recovers afterwards
+    CHECK(swf_decode_byte(&dec, SWF_DELIM) == SWF_PENDING);
+    CHECK(decode_all(&dec, enc, enc_len) == SWF_CON_LEN + 1);
+
+    // Too short to hold an opcode and CRC
+    uint8_t tiny[] = {0x02, 0x01, SWF_DELIM};
+    CHECK(decode_all(&dec, tiny, sizeof(tiny)) == SWF_ERROR);
+
+    // Overlong frames are dropped whole
+    for (int i = 0; i < SWF_MAX_ENCODED + 10; i++)
+        swf_decode_byte(&dec, 0x01);
+    CHECK(swf_decode_byte(&dec, SWF_DELIM) == SWF_ERROR);
+    CHECK(decode_all(&dec, enc, enc_len) == SWF_CON_LEN + 1);
+}
+
+int main(void)
+{
+    test_crc();
+    test_round_trip();
+    test_rejects();
+    return test_result("test_frame");
+}
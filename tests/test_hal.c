@@ -0,0 +1,138 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Platform functions for the host tests (see swicc_hal.h).
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "swicc_core.h"
+#include "swicc_movie.h"
+#include "swicc_hal.h"
+
+#define TEST_OUT_BYTES  (1024 * 1024)
+#define TEST_FLASH_BYTES (64 * 1024)
+
+int test_failures = 0;
+char test_out[TEST_OUT_BYTES + 1];
+size_t test_out_len = 0;
+uint64_t test_time_us = 0;
+
+static uint8_t test_flash[TEST_FLASH_BYTES];
+
+void test_out_clear(void)
+{
+    test_out_len = 0;
+    test_out[0] = 0;
+}
+
+void test_send(const char *str)
+{
+    while (*str)
+        process_rx_char(*str++);
+}
+
+int test_result(const char *name)
+{
+    if (test_failures)
+    {
+        printf("%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+void hal_uart_write(const uint8_t *data, size_t len)
+{
+    if (len > TEST_OUT_BYTES - test_out_len)
+        len = TEST_OUT_BYTES - test_out_len;
+    memcpy(test_out + test_out_len, data, len);
+    test_out_len += len;
+    test_out[test_out_len] = 0;
+}
+
+void hal_uart_puts(const char *str)
+{
+    hal_uart_write((const uint8_t *)str, strlen(str));
+}
+
+bool hal_uart_try_write(const uint8_t *data, size_t len)
+{
+    hal_uart_write(data, len);
+    return true;
+}
+
+void hal_set_baud(unsigned int rate)
+{
+    (void)rate;
+}
+
+unsigned int hal_rx_overruns(void)
+{
+    return 0;
+}
+
+uint64_t hal_time_us(void)
+{
+    return test_time_us;
+}
+
+// The tests call the frame update directly, so there is nothing to hold off
+uint32_t hal_irq_save(void)
+{
+    return 0;
+}
+
+void hal_irq_restore(uint32_t state)
+{
+    (void)state;
+}
+
+void hal_vsync_enable(bool en)
+{
+    (void)en;
+}
+
+uint32_t hal_movie_capacity(void)
+{
+    return TEST_FLASH_BYTES;
+}
+
+const uint8_t *hal_movie_data(void)
+{
+    return test_flash;
+}
+
+void hal_movie_erase(uint32_t offset)
+{
+    memset(test_flash + offset, 0xFF, MOVIE_SECTOR);
+}
+
+void hal_movie_program(uint32_t offset, const uint8_t *page)
+{
+    for (int i = 0; i < MOVIE_PAGE; i++)
+        test_flash[offset + i] &= page[i];
+}
@@ -0,0 +1,258 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Macros: loops and counts, long holds, definitions spread over MDEF and
+ *  MADD, and the pool staying consistent while a macro plays.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "swicc_core.h"
+#include "swicc_macro.h"
+
+// Start each test with an empty pool and the controller idle
+static void reset(void)
+{
+    buffer_init();
+    for (int i = 0; i < MACRO_COUNT; i++)
+    {
+        if (macros[i].name[0] != 0)
+            macro_delete(macros[i].name);
+    }
+    macro_task();
+    test_out_clear();
+}
+
+// Play frames and check the buttons of each
+static void expect(const uint16_t *buttons, unsigned int count)
+{
+    player_t *p = &players[0];
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        frame_update();
+        CHECK(p->action_mode == A_MACRO);
+        CHECK(p->current_con.Button == buttons[i]);
+    }
+}
+
+// The frame after the last one lets go of the controls and reports the end
+static void expect_end(uint32_t frames)
+{
+    player_t *p = &players[0];
+    char reply[24];
+
+    frame_update();
+    CHECK(p->action_mode == A_RT);
+    CHECK(are_cons_equal(p->current_con, neutral_con));
+
+    test_out_clear();
+    macro_task();
+    sprintf(reply, "+MEND %08X\r\n", (unsigned int)frames);
+    CHECK(strcmp(test_out, reply) == 0);
+
+    // Only once
+    test_out_clear();
+    macro_task();
+    CHECK(test_out_len == 0);
+}
+
+static void test_nested(void)
+{
+    static const uint16_t pass[] = {1, 2, 1, 2, 4};
+
+    reset();
+    test_send("+MDEF NEST [[000108 000208]2 000408]3 000808\n");
+    CHECK(strncmp(test_out, "+MDEF ", 6) == 0);
+    test_out_clear();
+    test_send("+MRUN NEST\n");
+    CHECK(strcmp(test_out, "+MRUN 1\r\n") == 0);
+
+    for (int i = 0; i < 3; i++)
+        expect(pass, 5);
+    static const uint16_t last[] = {8};
+    expect(last, 1);
+    expect_end(16);
+}
+
+// A count of 0 loops until stopped; any other count runs that many passes
+static void test_counts(void)
+{
+    static const uint16_t pair[] = {1, 2};
+    player_t *p = &players[0];
+
+    reset();
+    test_send("+MDEF ONCE [000108 000208]1\n");
+    test_send("+MDEF FOREVER [000108 000208]0\n");
+    test_send("+MRUN ONCE\n");
+    expect(pair, 2);
+    expect_end(2);
+
+    test_send("+MRUN FOREVER\n");
+    for (int i = 0; i < 1000; i++)
+        expect(pair, 2);
+
+    test_out_clear();
+    test_send("+MRUN \n");
+    CHECK(strcmp(test_out, "+MRUN 0\r\n") == 0);
+    CHECK(p->action_mode == A_RT);
+    CHECK(are_cons_equal(p->current_con, neutral_con));
+
+    // Stopped by the host, so no end report
+    frame_update();
+    test_out_clear();
+    macro_task();
+    CHECK(test_out_len == 0);
+}
+
+// Holds past 255 frames are split into waits
+static void test_long_hold(void)
+{
+    static const uint16_t one[] = {1};
+    static const uint16_t two[] = {2};
+
+    reset();
+    // 5 + 2 bytes for the state, 8 for the 1000 frame wait, 5 for the last
+    test_send("+MDEF LONG 000108:300 =:1000 000208\n");
+    CHECK(strcmp(test_out, "+MDEF 0014 0FEC\r\n") == 0);
+
+    test_send("+MRUN LONG\n");
+    for (int i = 0; i < 1300; i++)
+        expect(one, 1);
+    expect(two, 1);
+    expect_end(1301);
+
+    // Out of range
+    test_out_clear();
+    test_send("+MDEF BAD 000108:0\n");
+    test_send("+MDEF BAD 000108:65536\n");
+    CHECK(strcmp(test_out, "+MDEF ERR\r\n+MDEF ERR\r\n") == 0);
+}
+
+// A loop left open by MDEF is closed by MADD, and only then can run
+static void test_madd(void)
+{
+    static const uint16_t seq[] = {1, 2, 1, 2, 4};
+
+    reset();
+    test_send("+MDEF OPEN [000108\n");
+    test_out_clear();
+    test_send("+MRUN OPEN\n");
+    CHECK(strcmp(test_out, "+MRUN ERR\r\n") == 0);
+
+    // A bad line leaves the macro as it was
+    test_out_clear();
+    test_send("+MADD 000208]2]1\n");
+    CHECK(strcmp(test_out, "+MADD ERR\r\n") == 0);
+    CHECK(macros[macro_find("OPEN")].len == 8);
+
+    test_out_clear();
+    test_send("+MADD 000208]2\n");
+    CHECK(strncmp(test_out, "+MADD 000E ", 11) == 0);
+    test_send("+MADD 000408\n");
+
+    test_out_clear();
+    test_send("+MRUN OPEN\n");
+    CHECK(strcmp(test_out, "+MRUN 1\r\n") == 0);
+    expect(seq, 5);
+    expect_end(5);
+}
+
+// Redefining or deleting one macro moves the others in the pool; one that is
+// playing carries on where it was
+static void test_compact(void)
+{
+    static const uint16_t pass[] = {4, 4, 8, 8};
+    static const uint16_t redefined[] = {1, 1, 2};
+
+    reset();
+    test_send("+MDEF A [000108]0\n");
+    test_send("+MDEF B 000208:5\n");
+    test_send("+MDEF C [000408:2 000808:2]0\n");
+    CHECK(macros[macro_find("C")].start == 14);
+
+    test_send("+MRUN C\n");
+    expect(pass, 3);
+
+    // A moves to the end of the pool, C down into its place
+    test_send("+MDEF A 000108:2 000208\n");
+    CHECK(macros[macro_find("C")].start == 5);
+    CHECK(macros[macro_find("A")].start == 19);
+    expect(pass + 3, 1);
+    expect(pass, 4);
+
+    test_out_clear();
+    test_send("+MDEL B\n");
+    CHECK(strcmp(test_out, "+MDEL 1\r\n") == 0);
+    CHECK(macros[macro_find("C")].start == 0);
+    CHECK(macros[macro_find("A")].start == 14);
+    CHECK(macro_used == 24);
+    expect(pass, 4);
+
+    test_send("+MRUN A\n");
+    expect(redefined, 3);
+    expect_end(3);
+}
+
+// Deleting the macro that is playing stops it
+static void test_delete_running(void)
+{
+    static const uint16_t held[] = {4};
+    player_t *p = &players[0];
+
+    reset();
+    test_send("+MDEF RUN 000408:100\n");
+    test_send("+MRUN RUN\n");
+    for (int i = 0; i < 10; i++)
+        expect(held, 1);
+
+    test_out_clear();
+    test_send("+MDEL RUN\n");
+    CHECK(strcmp(test_out, "+MDEL 1\r\n") == 0);
+    CHECK(p->action_mode == A_RT);
+    CHECK(are_cons_equal(p->current_con, neutral_con));
+    CHECK(macro_used == 0);
+
+    frame_update();
+    CHECK(are_cons_equal(p->current_con, neutral_con));
+    test_out_clear();
+    macro_task();
+    CHECK(test_out_len == 0);
+
+    test_send("+MDEL RUN\n");
+    test_send("+MRUN RUN\n");
+    CHECK(strcmp(test_out, "+MDEL ERR\r\n+MRUN ERR\r\n") == 0);
+}
+
+int main(void)
+{
+    test_nested();
+    test_counts();
+    test_long_hold();
+    test_madd();
+    test_compact();
+    test_delete_running();
+    return test_result("test_macro");
+}
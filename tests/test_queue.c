@@ -0,0 +1,205 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* The controller queue on its own: empty, full, wrap and batches that cross
+ *  the end of the ring, and the hex decoding that feeds it.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "swicc_core.h"
+
+static USB_ControllerReport_Input_t con_with(uint16_t button)
+{
+    USB_ControllerReport_Input_t con = neutral_con;
+    con.Button = button;
+    return con;
+}
+
+// Play every queued state and check they come out in order
+static void drain(player_t *p, uint16_t first, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        frame_update();
+        CHECK(p->current_con.Button == (uint16_t)(first + i));
+    }
+    CHECK(get_queue_fill(p) == 0);
+}
+
+static void test_empty(void)
+{
+    player_t *p = &players[0];
+
+    buffer_init();
+    unsigned int rejected = p->queue_rejected;
+    CHECK(get_queue_fill(p) == 0);
+
+    // Playing an empty queue holds the current state
+    for (int i = 0; i < 3; i++)
+    {
+        frame_update();
+        CHECK(are_cons_equal(p->current_con, neutral_con));
+        CHECK(get_queue_fill(p) == 0);
+    }
+
+    CHECK(queue_con_batch(p, NULL, 0) == 0);
+    CHECK(get_queue_fill(p) == 0);
+    CHECK(p->queue_rejected == rejected);
+}
+
+static void test_full(void)
+{
+    player_t *p = &players[0];
+    USB_ControllerReport_Input_t con;
+
+    buffer_init();
+    unsigned int rejected = p->queue_rejected;
+    for (int i = 0; i < CON_BUFF_LEN - 1; i++)
+    {
+        con = con_with(i);
+        CHECK(queue_con(p, &con));
+    }
+    CHECK(get_queue_fill(p) == CON_BUFF_LEN - 1);
+
+    // One slot stays empty so a full ring is told apart from an empty one
+    con = con_with(0xFFFF);
+    CHECK(!queue_con(p, &con));
+    CHECK(p->queue_rejected - rejected == 1);
+    CHECK(get_queue_fill(p) == CON_BUFF_LEN - 1);
+
+    // Playing one frees one
+    frame_update();
+    CHECK(p->current_con.Button == 0);
+    CHECK(queue_con(p, &con));
+    CHECK(!queue_con(p, &con));
+    CHECK(p->queue_rejected - rejected == 2);
+}
+
+static void test_wrap(void)
+{
+    player_t *p = &players[0];
+    USB_ControllerReport_Input_t con;
+    uint16_t next = 0;
+
+    buffer_init();
+    unsigned int rejected = p->queue_rejected;
+    // Single states, several times round the ring, never more than 100 waiting
+    for (int round = 0; round < 8; round++)
+    {
+        uint16_t first = next;
+        for (int i = 0; i < 100; i++)
+        {
+            con = con_with(next++);
+            CHECK(queue_con(p, &con));
+        }
+        drain(p, first, 100);
+    }
+    CHECK(p->queue_rejected == rejected);
+}
+
+static void test_batch_wrap(void)
+{
+    player_t *p = &players[0];
+    USB_ControllerReport_Input_t cons[QB_MAX_FRAMES];
+
+    buffer_init();
+    // Move the head to a few entries before the end of the ring
+    unsigned int lead = CON_BUFF_LEN - 5;
+    for (unsigned int i = 0; i < lead; i++)
+    {
+        cons[0] = con_with(i);
+        CHECK(queue_con(p, &cons[0]));
+    }
+    drain(p, 0, lead);
+    CHECK(p->queue_head == lead);
+
+    // A batch that crosses index 0
+    for (int i = 0; i < QB_MAX_FRAMES; i++)
+        cons[i] = con_with(0x100 + i);
+    CHECK(queue_con_batch(p, cons, QB_MAX_FRAMES) == QB_MAX_FRAMES);
+    CHECK(get_queue_fill(p) == QB_MAX_FRAMES);
+    CHECK(p->queue_head < lead);
+    drain(p, 0x100, QB_MAX_FRAMES);
+
+    // A batch that only partly fits is cut short, not wrapped over the tail
+    unsigned int rejected = p->queue_rejected;
+    for (int i = 0; i < CON_BUFF_LEN - 1 - 10; i++)
+    {
+        cons[0] = con_with(i);
+        CHECK(queue_con(p, &cons[0]));
+    }
+    CHECK(queue_con_batch(p, cons, QB_MAX_FRAMES) == 10);
+    CHECK(p->queue_rejected - rejected == QB_MAX_FRAMES - 10);
+    CHECK(get_queue_fill(p) == CON_BUFF_LEN - 1);
+}
+
+static void test_hex(void)
+{
+    uint8_t out[8];
+    USB_ControllerReport_Input_t con;
+
+    CHECK(hex_decode("00FF7a", out, 3) == 3);
+    CHECK(out[0] == 0x00 && out[1] == 0xFF && out[2] == 0x7A);
+    CHECK(hex_decode("abcdef", out, 3) == 3);
+    CHECK(out[0] == 0xAB && out[1] == 0xCD && out[2] == 0xEF);
+
+    // Stops at the first non-hex character, and at len
+    CHECK(hex_decode("12G4", out, 2) == 1);
+    CHECK(hex_decode("123", out, 2) == 1);
+    CHECK(hex_decode("", out, 2) == 0);
+    CHECK(hex_decode("1234", out, 1) == 1);
+    CHECK(hex_decode("1/", out, 1) == 0);
+    CHECK(hex_decode(":0", out, 1) == 0);
+    CHECK(hex_decode("@0", out, 1) == 0);
+    CHECK(hex_decode("g0", out, 1) == 0);
+
+    // Upper and lower case give the same state
+    USB_ControllerReport_Input_t upper;
+    CHECK(parse_con_state("A5C30712345678", &upper) == 0);
+    CHECK(parse_con_state("a5c30712345678", &con) == 0);
+    CHECK(are_cons_equal(con, upper));
+    CHECK(con.Button == 0xA5C3 && con.HAT == 0x07);
+    CHECK(con.LX == 0x12 && con.LY == 0x34 && con.RX == 0x56 && con.RY == 0x78);
+
+    // The sticks are neutral unless all four are given
+    CHECK(parse_con_state("00040812", &con) == 0);
+    CHECK(con.Button == 0x0004 && con.HAT == 0x08);
+    CHECK(con.LX == 0x80 && con.LY == 0x80 && con.RX == 0x80 && con.RY == 0x80);
+
+    // The buttons and HAT are mandatory
+    CHECK(parse_con_state("00040", &con) < 0);
+    CHECK(parse_con_state("0004x8", &con) < 0);
+}
+
+int main(void)
+{
+    test_empty();
+    test_full();
+    test_wrap();
+    test_batch_wrap();
+    test_hex();
+    return test_result("test_queue");
+}
@@ -0,0 +1,227 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Compact recording format: encode/decode round trips, and a recording read
+ *  back through the binary bulk dump and decoded on the host side.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "swicc_core.h"
+#include "swicc_frame.h"
+#include "swicc_rec.h"
+
+#define RUNS 2000
+
+static uint8_t states[RUNS][SWF_CON_LEN];
+static uint32_t runs[RUNS];
+static uint8_t data[RUNS * REC_MAX_RECORD];
+
+// Run lengths around each varint size boundary
+static const uint32_t edge_runs[] = {
+    1, 2, 0x7F, 0x80, 0x3FFF, 0x4000, 0x1FFFFF, 0x200000,
+    0xFFFFFFF, 0x10000000, 0xFFFFFFFF
+};
+
+static void test_round_trip(void)
+{
+    uint8_t base[SWF_CON_LEN] = {0x00, 0x00, 0x08, 0x80, 0x80, 0x80, 0x80};
+    uint8_t prev[SWF_CON_LEN];
+    size_t len = 0;
+    const size_t edges = sizeof(edge_runs) / sizeof(edge_runs[0]);
+
+    srand(7);
+    memcpy(prev, base, SWF_CON_LEN);
+    for (size_t i = 0; i < RUNS; i++)
+    {
+        // Change a random subset of bytes, sometimes none or all of them
+        memcpy(states[i], prev, SWF_CON_LEN);
+        int mask = (i % 50 == 0) ? 0x7F : rand() & 0x7F;
+        for (int b = 0; b < SWF_CON_LEN; b++)
+        {
+            if (mask & (1 << b))
+                states[i][b] = rand() & 0xFF;
+        }
+        runs[i] = (i < edges) ? edge_runs[i] : (uint32_t)(1 + rand() % 1000);
+
+        size_t n = rec_encode(prev, states[i], runs[i], data + len);
+        CHECK(n >= 2 && n <= REC_MAX_RECORD);
+        len += n;
+        memcpy(prev, states[i], SWF_CON_LEN);
+    }
+
+    uint8_t state[SWF_CON_LEN];
+    size_t pos = 0;
+    memcpy(state, base, SWF_CON_LEN);
+    for (int i = 0; i < RUNS; i++)
+    {
+        uint32_t run;
+        int n = rec_decode(data + pos, len - pos, state, &run);
+        CHECK(n > 0);
+        if (n <= 0)
+            return;
+        CHECK(memcmp(state, states[i], SWF_CON_LEN) == 0);
+        CHECK(run == runs[i]);
+        pos += n;
+    }
+    CHECK(pos == len);
+}
+
+static void test_malformed(void)
+{
+    uint8_t prev[SWF_CON_LEN] = {0};
+    uint8_t state[SWF_CON_LEN] = {1, 2, 3, 4, 5, 6, 7};
+    uint8_t record[REC_MAX_RECORD];
+    uint32_t run;
+
+    size_t len = rec_encode(prev, state, 0xFFFFFFFF, record);
+    CHECK(len == REC_MAX_RECORD);
+
+    // Every truncation is refused
+    for (size_t n = 0; n < len; n++)
+        CHECK(rec_decode(record, n, prev, &run) < 0);
+
+    // Bit 7 of the mask is reserved
+    uint8_t bad_mask[] = {0x80, 0x01};
+    CHECK(rec_decode(bad_mask, sizeof(bad_mask), prev, &run) < 0);
+
+    // A varint may not run past five bytes
+    uint8_t long_run[] = {0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+    CHECK(rec_decode(long_run, sizeof(long_run), prev, &run) < 0);
+}
+
+// Send one binary frame to the device
+static void send_frame_to_device(uint8_t opcode, const uint8_t *payload, size_t len)
+{
+    uint8_t enc[SWF_MAX_ENCODED];
+    size_t n = swf_encode(opcode, payload, len, enc);
+    for (size_t i = 0; i < n; i++)
+        process_rx_char(enc[i]);
+}
+
+static void test_bulk_dump(void)
+{
+    static uint8_t dump[RUNS * REC_MAX_RECORD];
+    static uint16_t expect_button[RUNS];
+    static uint32_t expect_run[RUNS];
+    char cmd[32];
+    swf_decoder_t dec;
+
+    // Record runs of varied lengths
+    buffer_init();
+    test_send("+REC 1\n");
+    srand(3);
+    int count = 0;
+    expect_button[count] = 0;
+    expect_run[count] = 1;
+    for (int i = 1; i < 500; i++)
+    {
+        uint32_t run = 1 + rand() % 300;
+        sprintf(cmd, "+IMM %04X08\n", i);
+        test_send(cmd);
+        for (uint32_t f = 0; f < run; f++)
+            frame_update();
+        count++;
+        expect_button[count] = i;
+        expect_run[count] = run;
+    }
+    test_send("+REC 0\n");
+    count++;
+
+    // Dump everything, granting one credit at a time
+    test_send("+BIN 1\n");
+    test_out_clear();
+    send_frame_to_device(BOP_REC_DUMP, NULL, 0);
+
+    swf_decoder_reset(&dec);
+    uint8_t base[SWF_CON_LEN];
+    uint32_t records = 0, total = 0, got = 0;
+    uint16_t crc = 0;
+    bool ended = false;
+    size_t read = 0;
+
+    for (int credits = 0; credits < 10000 && !ended; credits++)
+    {
+        for (; read < test_out_len && !ended; read++)
+        {
+            int n = swf_decode_byte(&dec, (uint8_t)test_out[read]);
+            if (n <= 0)
+                continue;
+            const uint8_t *f = dec.buf;
+            if (f[0] == (BOP_REC_DUMP | BOP_REPLY) && n == 1 + 8 + SWF_CON_LEN)
+            {
+                records = get_be32(f + 1);
+                total = get_be32(f + 5);
+                memcpy(base, f + 9, SWF_CON_LEN);
+            }
+            else if (f[0] == (BOP_REC_DATA | BOP_REPLY))
+            {
+                CHECK(got + n - 3 <= sizeof(dump));
+                memcpy(dump + got, f + 3, n - 3);
+                got += n - 3;
+            }
+            else if (f[0] == (BOP_REC_END | BOP_REPLY))
+            {
+                crc = ((uint16_t)f[1] << 8) | f[2];
+                CHECK(get_be32(f + 3) == total);
+                ended = true;
+            }
+        }
+        uint8_t credit[2] = {0, 1};
+        send_frame_to_device(BOP_CREDIT, credit, sizeof(credit));
+        rec_dump_task();
+    }
+
+    CHECK(ended);
+    CHECK(records == (uint32_t)count);
+    CHECK(got == total);
+    CHECK(crc == swf_crc16(dump, got));
+
+    // Decode the dump with the host-side decoder and compare with the input
+    uint8_t state[SWF_CON_LEN];
+    memcpy(state, base, SWF_CON_LEN);
+    size_t pos = 0;
+    for (int i = 0; i < count && pos < got; i++)
+    {
+        uint32_t run;
+        int n = rec_decode(dump + pos, got - pos, state, &run);
+        CHECK(n > 0);
+        if (n <= 0)
+            return;
+        CHECK(((state[0] << 8) | state[1]) == expect_button[i]);
+        CHECK(run == expect_run[i]);
+        pos += n;
+    }
+    CHECK(pos == got);
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_malformed();
+    test_bulk_dump();
+    return test_result("test_rec");
+}
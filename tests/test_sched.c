@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Scheduled states: AT lands on its frame and takes over from queued
+ *  playback and macros the way IMM and their stop commands do.
+ */
+
+#include <string.h>
+
+#include "test.h"
+#include "swicc_core.h"
+#include "swicc_sched.h"
+#include "swicc_macro.h"
+
+static void schedule(uint32_t frame, uint16_t button)
+{
+    char cmd[48];
+    sprintf(cmd, "+AT %08X %04X08\n", (unsigned int)frame, button);
+    test_send(cmd);
+}
+
+// A state scheduled during queued playback drops what is left of the queue
+static void test_sched_queue(void)
+{
+    char cmd[32];
+    player_t *p = &players[0];
+
+    buffer_init();
+    for (int i = 1; i <= 20; i++)
+    {
+        sprintf(cmd, "+Q %04X08\n", i);
+        test_send(cmd);
+    }
+    uint32_t at = frame_seq + 5;
+    schedule(at, 0x0400);
+
+    while (frame_seq != at)
+        frame_update();
+    CHECK(p->current_con.Button == 5);
+
+    frame_update();
+    CHECK(p->current_con.Button == 0x0400);
+    CHECK(p->action_mode == A_RT);
+    CHECK(get_queue_fill(p) == 0);
+
+    // Nothing from the old queue comes back when playback resumes
+    test_send("+Q 000108\n");
+    frame_update();
+    CHECK(p->current_con.Button == 0x0001);
+    CHECK(sched_pending() == 0);
+}
+
+// A state scheduled while a macro runs stops it
+static void test_sched_macro(void)
+{
+    player_t *p = &players[0];
+
+    buffer_init();
+    test_out_clear();
+    test_send("+MDEF HOLD 000208:100\n");
+    test_send("+MRUN HOLD\n");
+    CHECK(strstr(test_out, "+MRUN 1\r\n") != NULL);
+
+    uint32_t at = frame_seq + 10;
+    schedule(at, 0x0400);
+    while (frame_seq != at)
+        frame_update();
+    CHECK(p->action_mode == A_MACRO);
+    CHECK(p->current_con.Button == 0x0002);
+
+    frame_update();
+    CHECK(p->action_mode == A_RT);
+    CHECK(p->current_con.Button == 0x0400);
+
+    // The macro stays stopped
+    for (int i = 0; i < 200; i++)
+        frame_update();
+    CHECK(p->current_con.Button == 0x0400);
+}
+
+// Late and full states are refused
+static void test_sched_refused(void)
+{
+    buffer_init();
+    sched_clear();
+    frame_update();
+    test_out_clear();
+    schedule(frame_seq - 1, 0x0001);
+    CHECK(strstr(test_out, "+AT LATE\r\n") != NULL);
+
+    for (int i = 0; i < SCHED_LEN; i++)
+        schedule(frame_seq + 100, i);
+    test_out_clear();
+    schedule(frame_seq + 100, 0x0001);
+    CHECK(strstr(test_out, "+AT FULL\r\n") != NULL);
+    sched_clear();
+}
+
+int main(void)
+{
+    test_sched_queue();
+    test_sched_macro();
+    test_sched_refused();
+    return test_result("test_sched");
+}
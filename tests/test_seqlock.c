@@ -0,0 +1,114 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Controller state publication: a writer thread publishes states as fast as
+ *  it can while a reader thread checks that every state it reads is whole.
+ *  Each published state has the same counter value in every byte, so a
+ *  state made of two different publications is easy to spot.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "test.h"
+#include "swicc_core.h"
+
+// How long to race the two threads for
+#define RUN_MS 500
+
+static volatile bool stop = false;
+
+static void fill_state(USB_ControllerReport_Input_t *con, uint8_t v)
+{
+    con->Button = (v << 8) | v;
+    con->HAT = v;
+    con->LX = v;
+    con->LY = v;
+    con->RX = v;
+    con->RY = v;
+    con->VendorSpec = v;
+}
+
+static bool state_whole(const USB_ControllerReport_Input_t *con)
+{
+    uint8_t v = con->HAT;
+    return con->Button == ((v << 8) | v) && con->LX == v && con->LY == v &&
+           con->RX == v && con->RY == v && con->VendorSpec == v;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *writer(void *arg)
+{
+    player_t *p = arg;
+
+    for (uint32_t i = 1; !__atomic_load_n(&stop, __ATOMIC_RELAXED); i++)
+    {
+        fill_state(&p->current_con, i & 0xFF);
+        con_publish(p);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    player_t *p = &players[0];
+    pthread_t thread;
+    unsigned long reads = 0, torn = 0, changes = 0;
+    uint8_t last = 0;
+
+    buffer_init();
+    fill_state(&p->current_con, 0);
+    con_publish(p);
+
+    uint64_t end_ms = now_ms() + RUN_MS;
+    pthread_create(&thread, NULL, writer, p);
+    while (now_ms() < end_ms)
+    {
+        USB_ControllerReport_Input_t con;
+        con_read(p, &con);
+        reads++;
+        if (!state_whole(&con))
+            torn++;
+        if (con.HAT != last)
+            changes++;
+        last = con.HAT;
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+
+    printf("%lu reads, %lu saw a new state, %lu torn\n", reads, changes, torn);
+    CHECK(torn == 0);
+    // The reader must actually have raced the writer.  On a single CPU the
+    // threads only interleave when the scheduler switches between them.
+    CHECK(changes > 1);
+
+    return test_result("test_seqlock");
+}
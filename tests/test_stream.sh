@@ -0,0 +1,62 @@
+#!/bin/sh
+# End-to-end streaming test: runs swicc_sim with a 2 ms frame, streams a
+# generated TAS file to it with swicc_stream, and checks that every state
+# was accepted with no queue underruns.
+#
+#   test_stream.sh <swicc_sim> <swicc_stream>
+
+SIM=$1
+STREAM=$2
+FRAME_US=2000
+
+dir=$(mktemp -d) || exit 1
+sim_pid=
+cleanup() {
+    [ -n "$sim_pid" ] && kill "$sim_pid" 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+# About 1500 frames of changing input, some states held for a few frames
+i=0
+while [ $i -lt 600 ]; do
+    printf '%04X08%02X%02X8080x%X\n' $((i * 37 % 16384)) $((i % 256)) $((255 - i % 256)) $((i % 5 + 1))
+    i=$((i + 1))
+done > "$dir/input.tas"
+
+"$SIM" -f $FRAME_US -l "$dir/pty" > "$dir/sim.out" 2>&1 &
+sim_pid=$!
+
+# Wait for the simulator to publish its pty
+tries=0
+while [ ! -e "$dir/pty" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 50 ]; then
+        echo "swicc_sim did not start"
+        cat "$dir/sim.out"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+"$STREAM" -f $FRAME_US "$dir/pty" "$dir/input.tas" > "$dir/stream.out" 2>&1
+status=$?
+cat "$dir/stream.out"
+
+if [ $status -ne 0 ]; then
+    echo "swicc_stream failed with status $status"
+    exit 1
+fi
+if ! grep -q "^Frames accepted: 1800 " "$dir/stream.out"; then
+    echo "not every frame was accepted"
+    exit 1
+fi
+if ! grep -q "^Underruns: 0$" "$dir/stream.out"; then
+    echo "the queue ran dry while streaming"
+    exit 1
+fi
+if grep -q "^Refused" "$dir/stream.out"; then
+    echo "the device refused states"
+    exit 1
+fi
+echo "test_stream: passed"
@@ -0,0 +1,440 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "swicc_host.h"
+
+//--------------------------------------------------------------------
+// Serial link
+//--------------------------------------------------------------------
+
+static speed_t baud_to_speed(unsigned int baud)
+{
+    switch (baud)
+    {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+    default: return 0;
+    }
+}
+
+/* Open the serial device in raw mode.  Returns 0, or -1 with errno set.
+ */
+int swh_open(swh_link_t *link, const char *path, unsigned int baud)
+{
+    struct termios tio;
+    speed_t speed = baud_to_speed(baud);
+
+    if (speed == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    link->line_len = 0;
+    link->fd = open(path, O_RDWR | O_NOCTTY);
+    if (link->fd < 0)
+        return -1;
+
+    if (tcgetattr(link->fd, &tio) < 0)
+    {
+        close(link->fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(link->fd, TCSANOW, &tio) < 0)
+    {
+        close(link->fd);
+        return -1;
+    }
+    tcflush(link->fd, TCIOFLUSH);
+
+    return 0;
+}
+
+void swh_close(swh_link_t *link)
+{
+    if (link->fd >= 0)
+        close(link->fd);
+    link->fd = -1;
+}
+
+/* Send a command.  cmd is everything after the "+", without the newline.
+ */
+int swh_send(swh_link_t *link, const char *cmd)
+{
+    char buf[SWH_LINE_LEN + 2];
+    int len = snprintf(buf, sizeof(buf), "+%s\n", cmd);
+
+    if (len < 0 || (size_t)len >= sizeof(buf))
+        return -1;
+
+    for (int sent = 0; sent < len;)
+    {
+        ssize_t n = write(link->fd, buf + sent, len - sent);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        sent += n;
+    }
+
+    return 0;
+}
+
+/* Read one reply line, without the line ending.
+ *  Returns the line length, 0 if nothing complete arrived within
+ *  timeout_ms, or -1 on error.
+ */
+int swh_read_line(swh_link_t *link, char *out, size_t len, int timeout_ms)
+{
+    uint64_t deadline = swh_time_us() + (uint64_t)timeout_ms * 1000;
+
+    while (1)
+    {
+        char *nl = memchr(link->line, '\n', link->line_len);
+        if (nl)
+        {
+            size_t n = nl - link->line;
+            size_t keep = link->line_len - (n + 1);
+            while (n > 0 && link->line[n - 1] == '\r')
+                n--;
+            if (n >= len)
+                n = len - 1;
+            memcpy(out, link->line, n);
+            out[n] = 0;
+            memmove(link->line, nl + 1, keep);
+            link->line_len = keep;
+            return n;
+        }
+
+        // A line longer than the buffer is garbage; drop it
+        if (link->line_len == sizeof(link->line))
+            link->line_len = 0;
+
+        uint64_t now = swh_time_us();
+        if (now >= deadline)
+            return 0;
+
+        struct pollfd pfd = {link->fd, POLLIN, 0};
+        int r = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if (r < 0 && errno != EINTR)
+            return -1;
+        if (r <= 0)
+            continue;
+
+        ssize_t n = read(link->fd, link->line + link->line_len, sizeof(link->line) - link->line_len);
+        if (n < 0 && errno != EINTR && errno != EAGAIN)
+            return -1;
+        if (n > 0)
+            link->line_len += n;
+    }
+}
+
+uint64_t swh_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//--------------------------------------------------------------------
+// TAS files
+//--------------------------------------------------------------------
+
+/* Load a TAS file.
+ *  Each line is a controller state in hex (6 or 14 digits, as for Q), with
+ *  an optional "x" and hex frame count, which is the format of the
+ *  recording readout; a leading "+R " is ignored, so a captured recording
+ *  can be played back as is.  Blank lines and lines starting with "#" are
+ *  skipped.  Returns 0, or -1 (with a message on stderr).
+ */
+int swh_tas_load(swh_tas_t *tas, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[SWH_LINE_LEN];
+    size_t cap = 0;
+    unsigned int line_num = 0;
+
+    tas->states = NULL;
+    tas->count = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char *p = line;
+        char state[SWH_STATE_HEX + 1];
+        size_t digits = 0;
+        unsigned long run = 1;
+
+        line_num++;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == 0 || *p == '#')
+            continue;
+        if (strncmp(p, "+R ", 3) == 0)
+            p += 3;
+
+        while (digits < SWH_STATE_HEX && isxdigit((unsigned char)p[digits]))
+        {
+            state[digits] = toupper((unsigned char)p[digits]);
+            digits++;
+        }
+        if (digits != 6 && digits != SWH_STATE_HEX)
+        {
+            fprintf(stderr, "%s:%u: bad controller state\n", path, line_num);
+            goto fail;
+        }
+        // Sticks default to neutral
+        if (digits == 6)
+            memcpy(state + 6, "80808080", 8);
+        state[SWH_STATE_HEX] = 0;
+
+        p += digits;
+        if (*p == 'x' || *p == 'X')
+        {
+            char *end;
+            run = strtoul(p + 1, &end, 16);
+            if (end == p + 1)
+            {
+                fprintf(stderr, "%s:%u: bad frame count\n", path, line_num);
+                goto fail;
+            }
+        }
+
+        while (tas->count + run > cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            void *grown = realloc(tas->states, cap * sizeof(*tas->states));
+            if (!grown)
+            {
+                fprintf(stderr, "%s: out of memory\n", path);
+                goto fail;
+            }
+            tas->states = grown;
+        }
+        for (unsigned long i = 0; i < run; i++)
+            memcpy(tas->states[tas->count++], state, sizeof(state));
+    }
+
+    fclose(f);
+    return 0;
+
+fail:
+    fclose(f);
+    swh_tas_free(tas);
+    return -1;
+}
+
+void swh_tas_free(swh_tas_t *tas)
+{
+    free(tas->states);
+    tas->states = NULL;
+    tas->count = 0;
+}
+
+//--------------------------------------------------------------------
+// Streaming
+//--------------------------------------------------------------------
+
+void swh_stream_defaults(swh_stream_opts_t *opts)
+{
+    opts->target_fill = 180;
+    opts->headroom = 8;
+    opts->max_inflight = 8;
+    opts->frame_us = 16667;
+    opts->verbose = false;
+}
+
+/* Stream a TAS into the playback queue.  Playback starts with the first
+ *  batch.  Returns 0 once every state has been accepted, or -1 on a link
+ *  error or if the device refused any states.
+ */
+int swh_stream(swh_link_t *link, const swh_tas_t *tas, const swh_stream_opts_t *opts,
+               swh_stream_stats_t *stats)
+{
+    // Sizes of the batches awaiting a reply, oldest first
+    size_t inflight[SWH_MAX_INFLIGHT];
+    unsigned int inflight_head = 0, inflight_count = 0;
+    unsigned int max_inflight = opts->max_inflight < SWH_MAX_INFLIGHT ? opts->max_inflight : SWH_MAX_INFLIGHT;
+
+    size_t next = 0;            // next state to send
+    size_t pending = 0;         // states sent but not yet replied to
+    unsigned int last_fill = 0; // device fill after the last replied batch
+    uint64_t last_us = 0;       // when that reply arrived
+    double frame_us = opts->frame_us;
+
+    // Drain rate measurement, restarted after an underrun
+    uint64_t rate_start_us = 0;
+    size_t rate_start_played = 0;
+    size_t accepted_total = 0;
+    double margin_sum = 0;
+    size_t margin_count = 0;
+    bool filled = false; // the queue has reached the target once
+
+    char cmd[SWH_LINE_LEN];
+    char line[SWH_LINE_LEN];
+
+    memset(stats, 0, sizeof(*stats));
+    stats->min_margin = SWH_QUEUE_CAPACITY;
+
+    while (next < tas->count || inflight_count > 0)
+    {
+        uint64_t now = swh_time_us();
+
+        // Estimated fill now, and an upper bound that allows for the frame
+        // clock being a frame behind the model
+        unsigned int drained = 0;
+        if (last_us)
+        {
+            drained = (unsigned int)((now - last_us) / frame_us);
+            if (drained > last_fill)
+                drained = last_fill;
+        }
+        unsigned int est = last_fill - drained + pending;
+        unsigned int upper = last_fill - (drained ? drained - 1 : 0) + pending;
+
+        unsigned int limit = SWH_QUEUE_CAPACITY - opts->headroom;
+        if (next < tas->count && inflight_count < max_inflight && est < opts->target_fill && upper < limit)
+        {
+            size_t n = limit - upper;
+            if (n > SWH_QB_MAX)
+                n = SWH_QB_MAX;
+            if (n > tas->count - next)
+                n = tas->count - next;
+
+            char *p = cmd + sprintf(cmd, "QB ");
+            for (size_t i = 0; i < n; i++)
+                p += sprintf(p, "%s", tas->states[next + i]);
+            if (swh_send(link, cmd) < 0)
+                return -1;
+
+            inflight[(inflight_head + inflight_count) % SWH_MAX_INFLIGHT] = n;
+            inflight_count++;
+            pending += n;
+            next += n;
+            continue;
+        }
+
+        // Wait for a reply, but not past the next frame
+        int r = swh_read_line(link, line, sizeof(line), (int)(frame_us / 1000) + 1);
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            continue;
+
+        unsigned int accepted, fill;
+        if (sscanf(line, "+QB %x %x", &accepted, &fill) != 2 || inflight_count == 0)
+        {
+            if (opts->verbose)
+                fprintf(stderr, "device: %s\n", line);
+            continue;
+        }
+
+        size_t sent = inflight[inflight_head];
+        inflight_head = (inflight_head + 1) % SWH_MAX_INFLIGHT;
+        inflight_count--;
+        pending -= sent;
+        now = swh_time_us();
+
+        stats->rejected += sent - accepted;
+        accepted_total += accepted;
+
+        // What was left in the queue when this batch landed.  Margins only
+        // count once the queue has first been filled up to the target.  A
+        // frame can play before the reply is built, leaving fill below
+        // accepted; that is an underrun too.
+        unsigned int margin = fill > accepted ? fill - accepted : 0;
+        if (filled)
+        {
+            if (margin == 0)
+            {
+                stats->underruns++;
+                rate_start_us = 0;
+            }
+            if (margin < stats->min_margin)
+                stats->min_margin = margin;
+            margin_sum += margin;
+            margin_count++;
+        }
+        if (fill >= opts->target_fill)
+            filled = true;
+        stats->batches++;
+
+        // Everything accepted and no longer queued has been played
+        size_t played = accepted_total - fill;
+        if (rate_start_us == 0)
+        {
+            rate_start_us = now;
+            rate_start_played = played;
+        }
+        else if (played - rate_start_played >= 60)
+            frame_us = (now - rate_start_us) / (double)(played - rate_start_played);
+
+        last_fill = fill;
+        last_us = now;
+
+        if (opts->verbose)
+            fprintf(stderr, "batch %zu: %u/%zu accepted, margin %u, fill %u, frame %.1f us\n",
+                    stats->batches, accepted, sent, margin, fill, frame_us);
+    }
+
+    stats->frames = accepted_total;
+    stats->frame_us = frame_us;
+    if (margin_count > 0)
+        stats->mean_margin = margin_sum / margin_count;
+    else
+        stats->min_margin = 0;
+
+    return stats->rejected ? -1 : 0;
+}
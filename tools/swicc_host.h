@@ -0,0 +1,102 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SWICC_HOST_H_
+#define SWICC_HOST_H_
+
+/* Host-side SwiCC library for Linux.
+ *  Opens the serial link, loads TAS files and streams them into the
+ *  playback queue.  The streamer does not poll GQF; it keeps QB batches in
+ *  flight and estimates the queue fill between replies from the drain rate
+ *  (one state per frame), which it measures as it goes.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Length of a controller state in hex, as sent with Q/QB
+#define SWH_STATE_HEX 14
+// Device limits (see swicc_core.h)
+#define SWH_QUEUE_CAPACITY 255
+#define SWH_QB_MAX 18
+// Most QB batches the streamer will keep awaiting a reply
+#define SWH_MAX_INFLIGHT 32
+
+#define SWH_LINE_LEN 256
+
+// Serial link to the device.
+typedef struct {
+    int fd;
+    char line[SWH_LINE_LEN]; // reply line being received
+    size_t line_len;
+} swh_link_t;
+
+// A TAS: one hex controller state per frame.
+typedef struct {
+    char (*states)[SWH_STATE_HEX + 1];
+    size_t count;
+} swh_tas_t;
+
+typedef struct {
+    unsigned int target_fill;  // fill the streamer aims for
+    unsigned int headroom;     // states kept free to allow for model error
+    unsigned int max_inflight; // most QB batches awaiting a reply
+    double frame_us;           // drain period to assume until measured
+    bool verbose;
+} swh_stream_opts_t;
+
+typedef struct {
+    size_t frames;          // states accepted by the device
+    size_t batches;
+    unsigned int min_margin; // lowest queue fill seen before a batch landed
+    double mean_margin;
+    size_t underruns;       // batches that found the queue empty
+    size_t rejected;        // states refused (should stay 0)
+    double frame_us;        // measured drain period
+} swh_stream_stats_t;
+
+int swh_open(swh_link_t *link, const char *path, unsigned int baud);
+void swh_close(swh_link_t *link);
+int swh_send(swh_link_t *link, const char *cmd);
+int swh_read_line(swh_link_t *link, char *out, size_t len, int timeout_ms);
+
+int swh_tas_load(swh_tas_t *tas, const char *path);
+void swh_tas_free(swh_tas_t *tas);
+
+void swh_stream_defaults(swh_stream_opts_t *opts);
+int swh_stream(swh_link_t *link, const swh_tas_t *tas, const swh_stream_opts_t *opts,
+               swh_stream_stats_t *stats);
+
+uint64_t swh_time_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWICC_HOST_H_ */
@@ -0,0 +1,272 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* swicc_sim: SwiCC device simulator on a pseudo-terminal.
+ *  Runs the firmware's core logic (src/swicc_core.c and friends) with a
+ *  frame timer, and serves the serial protocol on a pty so host tools can
+ *  be tried without hardware.  The pty's path is printed on startup.
+ *
+ *   swicc_sim [-f frame_us] [-l link path]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "swicc_core.h"
+#include "swicc_movie.h"
+#include "swicc_macro.h"
+#include "swicc_trace.h"
+#include "swicc_vsync.h"
+#include "swicc_hal.h"
+
+#define SIM_FLASH_BYTES (1024 * 1024)
+
+static int sim_fd = -1;
+static uint8_t sim_flash[SIM_FLASH_BYTES];
+static volatile sig_atomic_t sim_quit = 0;
+
+//--------------------------------------------------------------------
+// Platform functions for the core logic (see swicc_hal.h)
+//--------------------------------------------------------------------
+
+void hal_uart_write(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(sim_fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void hal_uart_puts(const char *str)
+{
+    hal_uart_write((const uint8_t *)str, strlen(str));
+}
+
+bool hal_uart_try_write(const uint8_t *data, size_t len)
+{
+    hal_uart_write(data, len);
+    return true;
+}
+
+void hal_set_baud(unsigned int rate)
+{
+    (void)rate;
+}
+
+unsigned int hal_rx_overruns(void)
+{
+    return 0;
+}
+
+uint64_t hal_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Everything runs on one thread, so there is nothing to hold off
+uint32_t hal_irq_save(void)
+{
+    return 0;
+}
+
+void hal_irq_restore(uint32_t state)
+{
+    (void)state;
+}
+
+// There is no VSYNC input; frames always come from the timer
+void hal_vsync_enable(bool en)
+{
+    (void)en;
+}
+
+uint32_t hal_movie_capacity(void)
+{
+    return SIM_FLASH_BYTES;
+}
+
+const uint8_t *hal_movie_data(void)
+{
+    return sim_flash;
+}
+
+void hal_movie_erase(uint32_t offset)
+{
+    memset(sim_flash + offset, 0xFF, MOVIE_SECTOR);
+}
+
+void hal_movie_program(uint32_t offset, const uint8_t *page)
+{
+    // Programming can only clear bits, as on real flash
+    for (unsigned int i = 0; i < MOVIE_PAGE; i++)
+        sim_flash[offset + i] &= page[i];
+}
+
+//--------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    sim_quit = 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frame_us = 16667;
+    const char *link_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': frame_us = strtoul(optarg, NULL, 10); break;
+        case 'l': link_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: swicc_sim [-f frame us] [-l link path]\n");
+            return 2;
+        }
+    }
+
+    sim_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim_fd < 0 || grantpt(sim_fd) < 0 || unlockpt(sim_fd) < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+    const char *pty_path = ptsname(sim_fd);
+
+    // Keep the other end open in raw mode, so nothing is echoed before a
+    // client connects and the pty survives clients coming and going
+    int peer_fd = open(pty_path, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (peer_fd < 0 || tcgetattr(peer_fd, &tio) < 0)
+    {
+        perror(pty_path);
+        return 1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(peer_fd, TCSANOW, &tio);
+
+    if (link_path)
+    {
+        unlink(link_path);
+        if (symlink(pty_path, link_path) < 0)
+        {
+            perror(link_path);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    buffer_init();
+    movie_init();
+
+    printf("%s\n", link_path ? link_path : pty_path);
+    fflush(stdout);
+
+    uint64_t next_frame = hal_time_us() + frame_us;
+    uint64_t next_report = hal_time_us() + 1000000;
+    unsigned int frames = 0, starved = 0, reported_starved = 0;
+    bool queued = false; // anything has been queued yet
+
+    while (!sim_quit)
+    {
+        uint64_t now = hal_time_us();
+
+        if (now >= next_frame)
+        {
+            // Playing with nothing new queued repeats the last state
+            for (int n = 0; n < SWICC_PLAYERS; n++)
+            {
+                if (get_queue_fill(&players[n]) > 0)
+                    queued = true;
+                else if (queued && players[n].action_mode == A_PLAY)
+                    starved++;
+            }
+            frame_update();
+            frames++;
+            next_frame += frame_us;
+            continue;
+        }
+
+        if (now >= next_report)
+        {
+            if (starved != reported_starved)
+                fprintf(stderr, "frame %u: %u starved frames\n", frames, starved);
+            reported_starved = starved;
+            next_report += 1000000;
+        }
+
+        struct pollfd pfd = {sim_fd, POLLIN, 0};
+        struct timespec timeout = {0, (long)(next_frame - now) * 1000};
+        if (ppoll(&pfd, 1, &timeout, NULL) > 0 && (pfd.revents & POLLIN))
+        {
+            uint8_t buf[256];
+            ssize_t n = read(sim_fd, buf, sizeof(buf));
+            for (ssize_t i = 0; i < n; i++)
+                process_rx_char(buf[i]);
+        }
+
+        baud_task();
+        rec_live_task();
+        rec_dump_task();
+        movie_task();
+        macro_task();
+        vpll_task();
+        trace_task();
+    }
+
+    fprintf(stderr, "%u frames, %u starved\n", frames, starved);
+    if (link_path)
+        unlink(link_path);
+    close(peer_fd);
+    close(sim_fd);
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 KNfLrPn
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* swicc_stream: play a TAS file through SwiCC's playback queue.
+ *
+ *   swicc_stream [-b baud] [-t target] [-f frame_us] [-v] <device> <tas file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "swicc_host.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: swicc_stream [-b baud] [-t target fill] [-f frame us] [-v] <device> <tas file>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    swh_stream_opts_t opts;
+    swh_stream_stats_t stats;
+    swh_link_t link;
+    swh_tas_t tas;
+    unsigned int baud = 115200;
+    int opt;
+
+    swh_stream_defaults(&opts);
+    while ((opt = getopt(argc, argv, "b:t:f:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b': baud = strtoul(optarg, NULL, 10); break;
+        case 't': opts.target_fill = strtoul(optarg, NULL, 10); break;
+        case 'f': opts.frame_us = strtod(optarg, NULL); break;
+        case 'v': opts.verbose = true; break;
+        default: usage();
+        }
+    }
+    if (argc - optind != 2 || opts.frame_us <= 0)
+        usage();
+    if (opts.target_fill > SWH_QUEUE_CAPACITY - opts.headroom)
+        opts.target_fill = SWH_QUEUE_CAPACITY - opts.headroom;
+
+    if (swh_tas_load(&tas, argv[optind + 1]) < 0)
+        return 1;
+    if (swh_open(&link, argv[optind], baud) < 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    printf("Streaming %zu frames\n", tas.count);
+    int result = swh_stream(&link, &tas, &opts, &stats);
+
+    printf("Frames accepted: %zu in %zu batches\n", stats.frames, stats.batches);
+    printf("Queue margin: min %u frames (%.1f ms), mean %.1f frames\n",
+           stats.min_margin, stats.min_margin * stats.frame_us / 1000, stats.mean_margin);
+    printf("Underruns: %zu\n", stats.underruns);
+    printf("Measured frame period: %.1f us\n", stats.frame_us);
+    if (stats.rejected)
+        printf("Refused by the device: %zu\n", stats.rejected);
+    if (result < 0 && !stats.rejected)
+        perror("link");
+
+    swh_close(&link);
+    swh_tas_free(&tas);
+    return result < 0 ? 1 : 0;
+}